@@ -0,0 +1,43 @@
+#include "mold.h"
+
+// CRC-32 as used by zlib and .gnu_debuglink (reflected, polynomial
+// 0xedb88320).
+
+static constexpr u32 CRC32_POLY = 0xedb88320;
+
+static std::array<u32, 256> crc32_table = []() {
+  std::array<u32, 256> tab;
+  for (i64 i = 0; i < 256; i++) {
+    u32 c = i;
+    for (i64 j = 0; j < 8; j++)
+      c = (c & 1) ? ((c >> 1) ^ CRC32_POLY) : (c >> 1);
+    tab[i] = c;
+  }
+  return tab;
+}();
+
+u32 compute_crc32(u32 crc, u8 *buf, i64 len) {
+  crc = ~crc;
+  for (i64 i = 0; i < len; i++)
+    crc = crc32_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+// Returns four bytes that, if appended to data whose CRC-32 is
+// `current`, make the CRC-32 of the whole data `desired`.
+//
+// CRC-32 is linear, and appending four bytes is equivalent to XOR'ing
+// them into the register and then shifting it 32 times. So we undo 32
+// shifts from the desired register value and XOR the result with the
+// current register value.
+std::vector<u8> crc32_solve(u32 current, u32 desired) {
+  u32 x = ~desired;
+  for (i64 i = 0; i < 32; i++) {
+    if (x & 0x80000000)
+      x = ((x ^ CRC32_POLY) << 1) | 1;
+    else
+      x <<= 1;
+  }
+  x ^= ~current;
+  return {(u8)x, (u8)(x >> 8), (u8)(x >> 16), (u8)(x >> 24)};
+}
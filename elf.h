@@ -13,8 +13,10 @@ typedef int32_t i32;
 typedef int64_t i64;
 
 static constexpr u32 SHN_UNDEF = 0;
+static constexpr u32 SHN_LORESERVE = 0xff00;
 static constexpr u32 SHN_ABS = 0xfff1;
 static constexpr u32 SHN_COMMON = 0xfff2;
+static constexpr u32 SHN_XINDEX = 0xffff;
 
 static constexpr u32 SHT_NULL = 0;
 static constexpr u32 SHT_PROGBITS = 1;
@@ -53,6 +55,9 @@ static constexpr u32 SHF_EXCLUDE = 0x80000000;
 
 static constexpr u32 GRP_COMDAT = 1;
 
+static constexpr u32 ELFCOMPRESS_ZLIB = 1;
+static constexpr u32 ELFCOMPRESS_ZSTD = 2;
+
 static constexpr u32 STT_NOTYPE = 0;
 static constexpr u32 STT_OBJECT = 1;
 static constexpr u32 STT_FUNC = 2;
@@ -249,6 +254,13 @@ struct ElfShdr {
   u64 sh_entsize;
 };
 
+struct ElfChdr {
+  u32 ch_type;
+  u32 ch_reserved;
+  u64 ch_size;
+  u64 ch_addralign;
+};
+
 struct ElfEhdr {
   u8 e_ident[16];
   u16 e_type;
@@ -0,0 +1,60 @@
+#include "mold.h"
+
+#include <unistd.h>
+
+std::string get_current_dir() {
+  char buf[PATH_MAX];
+  if (!getcwd(buf, sizeof(buf)))
+    Fatal() << "getcwd failed: " << strerror(errno);
+  return buf;
+}
+
+// Returns the last element of a given path.
+std::string path_filename(std::string_view path) {
+  while (path.size() > 1 && path.ends_with('/'))
+    path = path.substr(0, path.size() - 1);
+
+  size_t pos = path.find_last_of('/');
+  if (pos == path.npos || path.size() == 1)
+    return std::string(path);
+  return std::string(path.substr(pos + 1));
+}
+
+// Returns the shortest path name equivalent to a given path by purely
+// lexical processing. Symbolic links are not resolved.
+std::string path_clean(std::string_view path) {
+  bool is_abs = path.starts_with('/');
+  std::vector<std::string_view> elems;
+
+  while (!path.empty()) {
+    size_t pos = path.find('/');
+    std::string_view elem = path.substr(0, pos);
+    path = (pos == path.npos) ? "" : path.substr(pos + 1);
+
+    if (elem.empty() || elem == ".")
+      continue;
+
+    if (elem == "..") {
+      if (!elems.empty() && elems.back() != "..")
+        elems.pop_back();
+      else if (!is_abs)
+        elems.push_back(elem);
+      continue;
+    }
+    elems.push_back(elem);
+  }
+
+  std::string ret = is_abs ? "/" : "";
+  for (i64 i = 0; i < elems.size(); i++) {
+    if (i)
+      ret += "/";
+    ret += elems[i];
+  }
+  return ret.empty() ? "." : ret;
+}
+
+std::string path_to_absolute(std::string_view path, std::string_view cwd) {
+  if (path.starts_with('/'))
+    return path_clean(path);
+  return path_clean(std::string(cwd) + "/" + std::string(path));
+}
@@ -0,0 +1,291 @@
+// This file implements --gc-debug-info, which removes debug info for
+// code discarded by --gc-sections, COMDAT elimination or ICF.
+//
+// Without this, debug info for discarded code is copied to the output
+// and its references to discarded sections are resolved to address 0.
+// We remove it at two levels:
+//
+//  - If all code and data that debug sections of an object file refer
+//    to are discarded, all compilation units of the file are dead, so
+//    we discard all debug sections of the file.
+//
+//  - Otherwise, we remove sequences in .debug_line that describe
+//    discarded functions. A sequence is a unit of a line number program
+//    that usually covers one text section, which makes it easy to
+//    remove them individually.
+//
+// We don't rewrite .debug_info, .debug_ranges or .debug_loc of live
+// compilation units, because doing so requires parsing DIEs.
+
+#include "mold.h"
+
+#include <tbb/parallel_for_each.h>
+
+static constexpr u8 DW_LNS_fixed_advance_pc = 9;
+static constexpr u8 DW_LNE_end_sequence = 1;
+static constexpr u8 DW_LNE_set_address = 2;
+static constexpr u8 DW_LNE_define_file = 3;
+
+enum class RefKind { NONE, LIVE, DEAD };
+
+static bool is_debug_section(InputSection *isec) {
+  return isec && isec->is_alive && !isec->is_comdat_member &&
+         !(isec->shdr.sh_flags & SHF_ALLOC) &&
+         isec->name.starts_with(".debug");
+}
+
+// Returns whether a relocation in a debug section refers to live or
+// discarded code or data. References to other debug sections and
+// mergeable strings don't count.
+static RefKind get_ref_kind(ObjectFile &file, const ElfRela &rel) {
+  if (rel.r_sym == 0)
+    return RefKind::NONE;
+
+  const ElfSym &esym = file.elf_syms[rel.r_sym];
+  Symbol &sym = *file.symbols[rel.r_sym];
+
+  // If a symbol is not defined by this file, we have to ask the
+  // symbol's definition.
+  if (esym.is_undef() || esym.is_abs() || esym.is_common()) {
+    if (sym.input_section && !sym.input_section->is_alive)
+      return RefKind::DEAD;
+    return sym.frag ? RefKind::NONE : RefKind::LIVE;
+  }
+
+  const ElfShdr &shdr = file.elf_sections[file.get_shndx(esym)];
+  if (!(shdr.sh_flags & SHF_ALLOC) || (shdr.sh_flags & SHF_MERGE))
+    return RefKind::NONE;
+
+  // A symbol may be defined by this file but resolved to another file
+  // (e.g. a member of a duplicate COMDAT group). In that case, look at
+  // the section in this file, because that's what debug info describes.
+  // ICF reassigns symbols of folded sections to their leaders, so we
+  // look at the symbol for symbols owned by this file.
+  InputSection *isec = (sym.file == &file) ? sym.input_section
+                                           : file.get_section(esym);
+  if (isec && isec->is_alive)
+    return RefKind::LIVE;
+  return RefKind::DEAD;
+}
+
+static bool has_dead_debug_info(ObjectFile &file) {
+  bool has_dead_ref = false;
+
+  for (InputSection *isec : file.sections) {
+    if (!is_debug_section(isec))
+      continue;
+
+    for (const ElfRela &rel : isec->rels) {
+      switch (get_ref_kind(file, rel)) {
+      case RefKind::LIVE:
+        return false;
+      case RefKind::DEAD:
+        has_dead_ref = true;
+        break;
+      }
+    }
+  }
+  return has_dead_ref;
+}
+
+static u64 read_uleb(std::string_view data, i64 &pos) {
+  u64 val = 0;
+  i64 shift = 0;
+  while (pos < data.size()) {
+    u8 byte = data[pos++];
+    val |= (u64)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      break;
+    shift += 7;
+  }
+  return val;
+}
+
+// Returns byte ranges of sequences in a .debug_line section that
+// describe only discarded code. We handle only sections consisting
+// of a single line number program, because removing bytes from a
+// program moves the following ones, and .debug_info refers to them
+// by offset. That's what compilers emit for each object file.
+static std::vector<std::pair<i64, i64>>
+find_dead_sequences(ObjectFile &file, InputSection &isec) {
+  std::string_view data = isec.get_contents();
+  if (data.size() < 4)
+    return {};
+
+  u64 len = *(u32 *)data.data();
+  if (len == 0xffffffff || len + 4 != data.size() || len < 16)
+    return {};
+
+  u16 version = *(u16 *)(data.data() + 4);
+  if (version < 2 || 5 < version)
+    return {};
+
+  i64 pos = (version >= 5) ? 8 : 6;
+  i64 begin = pos + 4 + *(u32 *)(data.data() + pos);
+  pos += (version >= 4) ? 9 : 8;
+  if (begin > data.size() || pos >= begin)
+    return {};
+
+  u8 opcode_base = data[pos];
+  std::string_view opcode_lengths = data.substr(pos + 1);
+  if (opcode_base == 0 || opcode_lengths.size() < opcode_base - 1)
+    return {};
+
+  std::vector<std::pair<i64, i64>> ranges;
+  i64 seq_begin = begin;
+  bool is_dead = false;
+
+  for (i64 i = begin; i < data.size();) {
+    u8 op = data[i++];
+
+    // Special opcodes don't take operands.
+    if (op >= opcode_base)
+      continue;
+
+    if (op == 0) {
+      i64 len = read_uleb(data, i);
+      if (len == 0 || i + len > data.size())
+        return {};
+
+      u8 sub = data[i];
+      if (sub == DW_LNE_define_file)
+        return {};
+
+      if (sub == DW_LNE_set_address)
+        if (const ElfRela *rel = isec.find_rel(i + 1))
+          if (get_ref_kind(file, *rel) == RefKind::DEAD)
+            is_dead = true;
+
+      i += len;
+
+      if (sub == DW_LNE_end_sequence) {
+        if (is_dead)
+          ranges.push_back({seq_begin, i});
+        seq_begin = i;
+        is_dead = false;
+      }
+      continue;
+    }
+
+    if (op == DW_LNS_fixed_advance_pc) {
+      i += 2;
+      continue;
+    }
+
+    for (i64 j = 0; j < (u8)opcode_lengths[op - 1]; j++)
+      read_uleb(data, i);
+  }
+  return ranges;
+}
+
+static void compact_debug_line(ObjectFile &file, InputSection &isec) {
+  static Counter counter("removed_line_bytes");
+
+  isec.uncompress();
+  std::vector<std::pair<i64, i64>> ranges = find_dead_sequences(file, isec);
+  if (ranges.empty())
+    return;
+
+  // Copy live bytes to a new buffer.
+  std::string_view data = isec.get_contents();
+  i64 removed = 0;
+  for (auto [begin, end] : ranges)
+    removed += end - begin;
+
+  u8 *buf = new u8[data.size() - removed];
+  u8 *p = buf;
+  i64 pos = 0;
+  for (auto [begin, end] : ranges) {
+    memcpy(p, data.data() + pos, begin - pos);
+    p += begin - pos;
+    pos = end;
+  }
+  memcpy(p, data.data() + pos, data.size() - pos);
+  *(u32 *)buf = data.size() - removed - 4;
+
+  // Remove relocations in removed ranges and move the others.
+  std::vector<ElfRela> *rels = new std::vector<ElfRela>;
+  std::vector<RelInfo> *rel_info = new std::vector<RelInfo>;
+  std::vector<SectionFragmentRef> *rel_fragments =
+    new std::vector<SectionFragmentRef>;
+
+  i64 ref_idx = 0;
+  auto it = ranges.begin();
+  i64 delta = 0;
+
+  for (i64 i = 0; i < isec.rels.size(); i++) {
+    ElfRela rel = isec.rels[i];
+    const SectionFragmentRef *ref = nullptr;
+    if (isec.rel_info[i].has_fragment)
+      ref = &isec.rel_fragments[ref_idx++];
+
+    while (it != ranges.end() && it->second <= rel.r_offset) {
+      delta += it->second - it->first;
+      it++;
+    }
+
+    if (it != ranges.end() && it->first <= rel.r_offset)
+      continue;
+
+    rel.r_offset -= delta;
+    rels->push_back(rel);
+    rel_info->push_back(isec.rel_info[i]);
+    if (ref)
+      rel_fragments->push_back(*ref);
+  }
+
+  isec.rels = *rels;
+  isec.rel_info = *rel_info;
+  isec.rel_fragments = *rel_fragments;
+  isec.contents = {(char *)buf, (size_t)(data.size() - removed)};
+
+  // .debug_line has a private copy of its section header if
+  // --gc-debug-info is given.
+  const_cast<ElfShdr &>(isec.shdr).sh_size = isec.contents.size();
+  counter += removed;
+}
+
+void gc_debug_info() {
+  Timer t("gc_debug_info");
+  static Counter counter("removed_debug_sections");
+
+  // Find files whose debug sections are referred to by other files.
+  // It's rare, but we need to keep them.
+  std::unordered_map<ObjectFile *, i64> file_idx;
+  for (i64 i = 0; i < out::objs.size(); i++)
+    file_idx[out::objs[i]] = i;
+
+  std::vector<std::atomic_bool> is_referenced(out::objs.size());
+
+  tbb::parallel_for_each(out::objs, [&](ObjectFile *file) {
+    for (InputSection *isec : file->sections) {
+      if (!is_debug_section(isec))
+        continue;
+
+      for (const ElfRela &rel : isec->rels) {
+        InputSection *target = file->symbols[rel.r_sym]->input_section;
+        if (target && target->file != file && is_debug_section(target))
+          if (auto it = file_idx.find(target->file); it != file_idx.end())
+            is_referenced[it->second] = true;
+      }
+    }
+  });
+
+  tbb::parallel_for((i64)0, (i64)out::objs.size(), [&](i64 i) {
+    ObjectFile *file = out::objs[i];
+
+    if (!is_referenced[i] && has_dead_debug_info(*file)) {
+      for (InputSection *isec : file->sections) {
+        if (is_debug_section(isec)) {
+          isec->kill();
+          counter++;
+        }
+      }
+      return;
+    }
+
+    for (InputSection *isec : file->sections)
+      if (is_debug_section(isec) && isec->name == ".debug_line")
+        compact_debug_line(*file, *isec);
+  });
+}
@@ -0,0 +1,316 @@
+// This file implements --gdb-index. .gdb_index is an index of debug
+// info that gdb reads at startup instead of scanning all of DWARF.
+// It consists of the following parts:
+//
+//  - a header
+//  - a list of compilation units (offsets and sizes in .debug_info)
+//  - an empty list of type units
+//  - an address area, which maps address ranges to compilation units
+//  - a hash table mapping names to offsets in the constant pool
+//  - a constant pool containing names and, for each name, a vector of
+//    compilation units defining the name
+//
+// Compilation units are read from .debug_info, address ranges from
+// .debug_aranges, and names from .debug_gnu_pubnames/pubtypes (or
+// .debug_pubnames/pubtypes) of input files. Input files are processed
+// in parallel, and names are merged using a concurrent hash map.
+//
+// Addresses are not known until output sections are laid out, so the
+// address area is filled in when the section is copied to the output.
+
+#include "mold.h"
+
+#include <bit>
+#include <tbb/concurrent_hash_map.h>
+#include <tbb/parallel_for_each.h>
+
+static constexpr u32 GDB_INDEX_VERSION = 7;
+
+static constexpr u8 DW_UT_compile = 1;
+static constexpr u8 DW_UT_partial = 3;
+static constexpr u8 DW_UT_skeleton = 4;
+
+// The hash function used by gdb for the symbol table of version 5 or
+// later indices.
+static u32 gdb_hash(std::string_view name) {
+  u32 h = 0;
+  for (u8 c : name)
+    h = h * 67 + tolower(c) - 113;
+  return h;
+}
+
+// Returns the symbol a field at a given offset is relocated against,
+// or nullptr if the field is not relocated.
+static Symbol *get_rel_symbol(InputSection &isec, u64 offset, i64 &addend) {
+  const ElfRela *rel = isec.find_rel(offset);
+  if (!rel)
+    return nullptr;
+  addend = rel->r_addend;
+  return isec.file->symbols[rel->r_sym];
+}
+
+// Returns the offset in the output .debug_info that a field of a given
+// section refers to, or -1 if it refers to a discarded section.
+static i64 get_info_offset(InputSection &isec, u64 offset) {
+  i64 addend;
+  Symbol *sym = get_rel_symbol(isec, offset, addend);
+  if (!sym || !sym->input_section || !sym->input_section->is_alive)
+    return -1;
+  return sym->input_section->offset + sym->value + addend;
+}
+
+static bool is_alive_debug_section(InputSection *isec,
+                                   std::string_view name) {
+  return isec && isec->is_alive && isec->name == name &&
+         isec->shdr.sh_size > 0;
+}
+
+void GdbIndexSection::read_compunits(ObjectFile &file,
+                                     std::vector<Compunit> &vec) {
+  for (InputSection *isec : file.sections) {
+    if (!is_alive_debug_section(isec, ".debug_info"))
+      continue;
+
+    isec->uncompress();
+    std::string_view data = isec->get_contents();
+
+    for (u64 off = 0; off + 4 <= data.size();) {
+      u64 len = *(u32 *)(data.data() + off);
+      if (len == 0xffffffff)
+        Fatal() << *isec << ": 64-bit DWARF is not supported";
+      if (off + len + 4 > data.size() || len < 3)
+        Fatal() << *isec << ": corrupted .debug_info";
+
+      // DWARF 5 .debug_info can contain type units too.
+      u16 version = *(u16 *)(data.data() + off + 4);
+      u8 unit_type = data[off + 6];
+      if (version < 5 || unit_type == DW_UT_compile ||
+          unit_type == DW_UT_partial || unit_type == DW_UT_skeleton)
+        vec.push_back({isec->offset + off, len + 4});
+      off += len + 4;
+    }
+  }
+}
+
+i64 GdbIndexSection::find_compunit(i64 offset) {
+  auto it = std::lower_bound(compunits.begin(), compunits.end(), offset,
+                             [](const Compunit &cu, i64 offset) {
+    return cu.offset < offset;
+  });
+
+  if (it != compunits.end() && it->offset == offset)
+    return it - compunits.begin();
+  return -1;
+}
+
+// .debug_aranges consists of sets, one for each compilation unit.
+// A set is a header followed by (address, length) tuples.
+void GdbIndexSection::read_aranges(ObjectFile &file,
+                                   std::vector<AddressRange> &vec) {
+  for (InputSection *isec : file.sections) {
+    if (!is_alive_debug_section(isec, ".debug_aranges"))
+      continue;
+
+    isec->uncompress();
+    std::string_view data = isec->get_contents();
+
+    for (u64 off = 0; off + 12 <= data.size();) {
+      u64 len = *(u32 *)(data.data() + off);
+      if (len == 0xffffffff)
+        Fatal() << *isec << ": 64-bit DWARF is not supported";
+
+      u64 end = off + len + 4;
+      if (end > data.size())
+        Fatal() << *isec << ": corrupted .debug_aranges";
+
+      i64 cu_idx = find_compunit(get_info_offset(*isec, off + 6));
+      u8 addr_size = data[off + 10];
+
+      if (cu_idx != -1 && addr_size == 8) {
+        // Tuples are aligned to twice the size of an address.
+        for (u64 i = off + 16; i + 16 <= end; i += 16) {
+          u64 size = *(u64 *)(data.data() + i + 8);
+          i64 addend;
+          Symbol *sym = get_rel_symbol(*isec, i, addend);
+
+          if (!sym || size == 0)
+            continue;
+          if (sym->input_section && !sym->input_section->is_alive)
+            continue;
+          vec.push_back({sym, addend, size, (u32)cu_idx});
+        }
+      }
+      off = end;
+    }
+  }
+}
+
+// .debug_gnu_pubnames and .debug_gnu_pubtypes consist of sets, one for
+// each compilation unit. A set is a header followed by (DIE offset,
+// flags, name) tuples and terminated by a zero DIE offset. The flags
+// byte, which is in the same format as the attributes of the CU vectors
+// in .gdb_index, is absent in .debug_pubnames and .debug_pubtypes.
+void GdbIndexSection::read_pubnames(ObjectFile &file, NameMap &map) {
+  static Counter counter("gdb_index_names");
+
+  for (InputSection *isec : file.sections) {
+    if (!isec || !isec->is_alive || isec->shdr.sh_size == 0)
+      continue;
+
+    bool has_flags;
+    if (isec->name == ".debug_gnu_pubnames" ||
+        isec->name == ".debug_gnu_pubtypes")
+      has_flags = true;
+    else if (isec->name == ".debug_pubnames" ||
+             isec->name == ".debug_pubtypes")
+      has_flags = false;
+    else
+      continue;
+
+    isec->uncompress();
+    std::string_view data = isec->get_contents();
+
+    for (u64 off = 0; off + 14 <= data.size();) {
+      u64 len = *(u32 *)(data.data() + off);
+      if (len == 0xffffffff)
+        Fatal() << *isec << ": 64-bit DWARF is not supported";
+
+      u64 end = off + len + 4;
+      if (end > data.size())
+        Fatal() << *isec << ": corrupted " << isec->name;
+
+      i64 cu_idx = find_compunit(get_info_offset(*isec, off + 6));
+
+      for (u64 i = off + 14; cu_idx != -1 && i + 4 <= end;) {
+        if (*(u32 *)(data.data() + i) == 0)
+          break;
+        i += 4;
+
+        u8 flags = 0;
+        if (has_flags)
+          flags = data[i++];
+
+        std::string_view name = data.substr(i);
+        name = name.substr(0, name.find('\0'));
+        i += name.size() + 1;
+
+        NameMap::accessor acc;
+        if (map.insert(acc, name))
+          acc->second.hash = gdb_hash(name);
+        acc->second.attrs.push_back(cu_idx | ((u32)flags << 24));
+        counter++;
+      }
+      off = end;
+    }
+  }
+}
+
+void GdbIndexSection::construct() {
+  Timer t("gdb_index");
+
+  // Read compilation units.
+  std::vector<std::vector<Compunit>> cus(out::objs.size());
+  tbb::parallel_for((i64)0, (i64)out::objs.size(), [&](i64 i) {
+    read_compunits(*out::objs[i], cus[i]);
+  });
+
+  compunits = flatten(cus);
+  sort(compunits, [](const Compunit &a, const Compunit &b) {
+    return a.offset < b.offset;
+  });
+
+  // Read address ranges and names.
+  std::vector<std::vector<AddressRange>> ranges(out::objs.size());
+  NameMap map;
+
+  tbb::parallel_for((i64)0, (i64)out::objs.size(), [&](i64 i) {
+    read_aranges(*out::objs[i], ranges[i]);
+    read_pubnames(*out::objs[i], map);
+  });
+
+  address_ranges = flatten(ranges);
+
+  // Sort names so that the output is deterministic.
+  std::vector<std::pair<std::string_view, NameEntry *>> names;
+  names.reserve(map.size());
+  for (auto &[name, ent] : map)
+    names.push_back({name, &ent});
+  std::sort(names.begin(), names.end());
+
+  tbb::parallel_for_each(names, [](std::pair<std::string_view, NameEntry *> &p) {
+    std::vector<u32> &vec = p.second->attrs;
+    std::sort(vec.begin(), vec.end());
+    vec.erase(std::unique(vec.begin(), vec.end()), vec.end());
+  });
+
+  // Compute the layout.
+  i64 hash_size = std::bit_ceil<u64>(names.size() * 4 / 3 + 1);
+
+  cu_list_offset = 24;
+  address_area_offset = cu_list_offset + compunits.size() * 16;
+  symtab_offset = address_area_offset + address_ranges.size() * 20;
+  constant_pool_offset = symtab_offset + hash_size * 8;
+
+  // Build the hash table and the constant pool. CU vectors come first
+  // in the constant pool, followed by names.
+  std::vector<u32> symtab(hash_size * 2);
+  i64 vec_size = 0;
+  for (std::pair<std::string_view, NameEntry *> &p : names)
+    vec_size += (p.second->attrs.size() + 1) * 4;
+
+  pool.clear();
+  pool.resize(vec_size);
+  i64 vec_offset = 0;
+
+  for (auto &[name, ent] : names) {
+    u32 mask = hash_size - 1;
+    u32 step = ((ent->hash * 17) & mask) | 1;
+    u32 idx = ent->hash & mask;
+    while (symtab[idx * 2] || symtab[idx * 2 + 1])
+      idx = (idx + step) & mask;
+
+    symtab[idx * 2] = pool.size();
+    symtab[idx * 2 + 1] = vec_offset;
+
+    u32 *vec = (u32 *)(pool.data() + vec_offset);
+    vec[0] = ent->attrs.size();
+    memcpy(vec + 1, ent->attrs.data(), ent->attrs.size() * 4);
+    vec_offset += (ent->attrs.size() + 1) * 4;
+
+    pool.insert(pool.end(), name.begin(), name.end());
+    pool.push_back('\0');
+  }
+
+  hash_table = std::move(symtab);
+  shdr.sh_size = constant_pool_offset + pool.size();
+}
+
+void GdbIndexSection::copy_buf() {
+  u8 *base = out::buf + shdr.sh_offset;
+
+  u32 *hdr = (u32 *)base;
+  hdr[0] = GDB_INDEX_VERSION;
+  hdr[1] = cu_list_offset;
+  hdr[2] = address_area_offset; // type unit list, which is empty
+  hdr[3] = address_area_offset;
+  hdr[4] = symtab_offset;
+  hdr[5] = constant_pool_offset;
+
+  u64 *cu = (u64 *)(base + cu_list_offset);
+  for (Compunit &c : compunits) {
+    *cu++ = c.offset;
+    *cu++ = c.size;
+  }
+
+  u8 *addr = base + address_area_offset;
+  for (AddressRange &r : address_ranges) {
+    u64 begin = r.sym->get_addr() + r.addend;
+    *(u64 *)addr = begin;
+    *(u64 *)(addr + 8) = begin + r.size;
+    *(u32 *)(addr + 16) = r.cu_idx;
+    addr += 20;
+  }
+
+  memcpy(base + symtab_offset, hash_table.data(), hash_table.size() * 4);
+  memcpy(base + constant_pool_offset, pool.data(), pool.size());
+}
@@ -99,14 +99,15 @@ static void uniquify_cies() {
 static bool is_eligible(InputSection &isec) {
   bool is_alloc = (isec.shdr.sh_flags & SHF_ALLOC);
   bool is_executable = (isec.shdr.sh_flags & SHF_EXECINSTR);
-  bool is_relro = (isec.name == ".data.rel.ro" ||
-                   isec.name.starts_with(".data.rel.ro."));
-  bool is_readonly = !(isec.shdr.sh_flags & SHF_WRITE) || is_relro;
+  bool is_readonly =
+    !(isec.shdr.sh_flags & SHF_WRITE) || isec.name_info->is_relro;
   bool is_bss = (isec.shdr.sh_type == SHT_NOBITS);
   bool is_empty = (isec.shdr.sh_size == 0);
-  bool is_init = (isec.shdr.sh_type == SHT_INIT_ARRAY || isec.name == ".init");
-  bool is_fini = (isec.shdr.sh_type == SHT_FINI_ARRAY || isec.name == ".fini");
-  bool is_enumerable = is_c_identifier(isec.name);
+  bool is_init =
+    (isec.shdr.sh_type == SHT_INIT_ARRAY || isec.name_info->is_init);
+  bool is_fini =
+    (isec.shdr.sh_type == SHT_FINI_ARRAY || isec.name_info->is_fini);
+  bool is_enumerable = isec.name_info->is_c_identifier;
 
   return is_alloc && is_executable && is_readonly && !is_bss &&
          !is_empty && !is_init && !is_fini && !is_enumerable;
@@ -270,7 +271,7 @@ static Digest compute_digest(InputSection &isec) {
     hash(rel.r_type);
     hash(rel.r_addend);
 
-    if (isec.has_fragments[i]) {
+    if (isec.rel_info[i].has_fragment) {
       SectionFragmentRef &ref = isec.rel_fragments[ref_idx++];
       hash('1');
       hash(ref.addend);
@@ -338,7 +339,7 @@ static void gather_edges(std::span<InputSection *> sections,
     assert(isec.icf_eligible);
 
     for (i64 j = 0; j < isec.rels.size(); j++) {
-      if (!isec.has_fragments[j]) {
+      if (!isec.rel_info[j].has_fragment) {
         ElfRela &rel = isec.rels[j];
         Symbol &sym = *isec.file->symbols[rel.r_sym];
         if (!sym.frag && sym.input_section && sym.input_section->icf_eligible)
@@ -357,7 +358,7 @@ static void gather_edges(std::span<InputSection *> sections,
     i64 idx = edge_indices[i];
 
     for (i64 j = 0; j < isec.rels.size(); j++) {
-      if (!isec.has_fragments[j]) {
+      if (!isec.rel_info[j].has_fragment) {
         ElfRela &rel = isec.rels[j];
         Symbol &sym = *isec.file->symbols[rel.r_sym];
         if (!sym.frag && sym.input_section && sym.input_section->icf_eligible)
@@ -1,14 +1,261 @@
 #include "mold.h"
 
 #include <limits>
+#include <tbb/concurrent_unordered_set.h>
+#include <zlib.h>
+#include <zstd.h>
+
+static std::string_view get_output_name(std::string_view name) {
+  static std::string_view common_names[] = {
+    ".text.", ".data.rel.ro.", ".data.", ".rodata.", ".bss.rel.ro.",
+    ".bss.", ".init_array.", ".fini_array.", ".tbss.", ".tdata.",
+  };
+
+  for (std::string_view s1 : common_names) {
+    std::string_view s2 = s1.substr(0, s1.size() - 1);
+    if (name.starts_with(s1) || name == s2)
+      return s2;
+  }
+  return name;
+}
+
+// There are usually only a few thousand unique section names even
+// if there are millions of input sections, so each thread keeps a
+// cache in front of the shared map.
+const SectionNameInfo *SectionNameInfo::get(std::string_view name) {
+  thread_local std::unordered_map<std::string_view, SectionNameInfo *> cache;
+  if (auto it = cache.find(name); it != cache.end())
+    return it->second;
+
+  static tbb::concurrent_hash_map<std::string_view, SectionNameInfo> map;
+  static Counter counter("unique_section_names");
+
+  decltype(map)::accessor acc;
+  if (map.insert(acc, name)) {
+    SectionNameInfo &info = acc->second;
+    info.output_name = get_output_name(name);
+    info.is_c_identifier = ::is_c_identifier(name);
+    info.is_init = (name == ".init");
+    info.is_fini = (name == ".fini");
+    info.is_init_fini = name.starts_with(".ctors") ||
+                        name.starts_with(".dtors") ||
+                        name.starts_with(".init") ||
+                        name.starts_with(".fini");
+    info.is_relro = (name == ".data.rel.ro" ||
+                     name.starts_with(".data.rel.ro."));
+    counter++;
+  }
+
+  cache[name] = &acc->second;
+  return &acc->second;
+}
 
 InputChunk::InputChunk(ObjectFile *file, const ElfShdr &shdr,
-                       std::string_view name)
-  : file(file), shdr(shdr), name(name),
-    output_section(OutputSection::get_instance(name, shdr.sh_type, shdr.sh_flags)) {}
+                       std::string_view name, const SectionNameInfo *name_info)
+  : file(file), shdr(shdr),
+    output_section(OutputSection::get_instance(name_info, shdr.sh_type,
+                                               shdr.sh_flags)),
+    name(name), name_info(name_info) {}
+
+// A compressed section starts with an ElfChdr which contains the size
+// and alignment of the uncompressed data. We create a section header
+// for the uncompressed data so that the rest of the linker doesn't have
+// to care about compression.
+//
+// --gc-debug-info may shrink .debug_line sections, so they get a copy
+// of the section header too.
+static const ElfShdr &get_private_shdr(ObjectFile *file, const ElfShdr &shdr,
+                                       std::string_view name) {
+  if (!(shdr.sh_flags & SHF_COMPRESSED)) {
+    if (config.gc_debug_info && name == ".debug_line")
+      return file->private_shdrs.emplace_back(shdr);
+    return shdr;
+  }
+
+  std::string_view data = file->get_string(shdr);
+  if (data.size() < sizeof(ElfChdr))
+    Fatal() << *file << ": corrupted compressed section";
+
+  ElfChdr &chdr = *(ElfChdr *)data.data();
+  if (chdr.ch_type != ELFCOMPRESS_ZLIB && chdr.ch_type != ELFCOMPRESS_ZSTD)
+    Fatal() << *file << ": unsupported compression type: " << chdr.ch_type;
+
+  ElfShdr &copy = file->private_shdrs.emplace_back(shdr);
+  copy.sh_flags &= ~(u64)SHF_COMPRESSED;
+  copy.sh_size = chdr.ch_size;
+  copy.sh_addralign = chdr.ch_addralign;
+  return copy;
+}
+
+InputSection::InputSection(ObjectFile *file, const ElfShdr &shdr,
+                           std::string_view name, i64 section_idx)
+  : InputChunk(file, get_private_shdr(file, shdr, name), name,
+               SectionNameInfo::get(name)),
+    section_idx(section_idx) {
+  if (shdr.sh_flags & SHF_COMPRESSED)
+    compressed_contents = file->get_string(shdr);
+  else if (shdr.sh_type != SHT_NOBITS)
+    contents = file->get_string(shdr);
+}
+
+static void uncompress_to(InputSection &isec, u8 *buf) {
+  ElfChdr &chdr = *(ElfChdr *)isec.compressed_contents.data();
+  std::string_view data = isec.compressed_contents.substr(sizeof(ElfChdr));
+  u64 size = isec.shdr.sh_size;
+
+  switch (chdr.ch_type) {
+  case ELFCOMPRESS_ZLIB: {
+    unsigned long len = size;
+    if (::uncompress(buf, &len, (u8 *)data.data(), data.size()) != Z_OK ||
+        len != size)
+      Fatal() << isec << ": uncompress failed";
+    break;
+  }
+  case ELFCOMPRESS_ZSTD:
+    if (ZSTD_decompress(buf, size, data.data(), data.size()) != size)
+      Fatal() << isec << ": uncompress failed";
+    break;
+  default:
+    unreachable();
+  }
+
+  static Counter counter("uncompressed_sections");
+  counter++;
+}
+
+// Uncompressed contents that have to stay in memory are allocated from
+// per-thread buffers so that threads don't contend on malloc.
+static u8 *alloc_uncompress_buffer(i64 size) {
+  static constexpr i64 BUFFER_SIZE = 4 * 1024 * 1024;
+  thread_local u8 *cur = nullptr;
+  thread_local u8 *end = nullptr;
+
+  if (size > BUFFER_SIZE / 4)
+    return (u8 *)malloc(size);
+
+  i64 alloc_size = align_to(size, 16);
+  if (end - cur < alloc_size) {
+    cur = (u8 *)malloc(BUFFER_SIZE);
+    end = cur + BUFFER_SIZE;
+  }
+
+  u8 *buf = cur;
+  cur += alloc_size;
+  return buf;
+}
+
+void InputSection::uncompress() {
+  if (compressed_contents.empty() || !contents.empty())
+    return;
+
+  u8 *buf = alloc_uncompress_buffer(shdr.sh_size);
+  uncompress_to(*this, buf);
+  contents = {(char *)buf, (size_t)shdr.sh_size};
+}
+
+// A mis-configured link (e.g. one with a missing library) can have
+// millions of relocations referring to undefined symbols. Instead of
+// reporting each of them, we collect them in per-thread maps and report
+// each symbol once with a few locations that refer to it.
+namespace {
+struct UndefLoc {
+  InputSection *isec;
+  u64 offset;
+};
+
+struct UndefRefs {
+  std::vector<UndefLoc> locs;
+  i64 count = 0;
+};
+
+std::ostream &operator<<(std::ostream &out, const UndefLoc &loc) {
+  out << *loc.isec->file << ":(" << loc.isec->name << "+0x"
+      << std::hex << loc.offset << std::dec << ")";
+  return out;
+}
+}
+
+static constexpr i64 MAX_UNDEF_LOCS = 3;
+
+static tbb::enumerable_thread_specific<std::unordered_map<Symbol *, UndefRefs>>
+  undef_refs;
+static tbb::concurrent_unordered_set<Symbol *> undef_syms;
+
+static bool loc_less(const UndefLoc &a, const UndefLoc &b) {
+  return std::tuple(a.isec->file->priority, a.isec->section_idx, a.offset) <
+         std::tuple(b.isec->file->priority, b.isec->section_idx, b.offset);
+}
+
+void add_undefined_symbol(InputSection &isec, Symbol &sym, u64 offset) {
+  UndefRefs &refs = undef_refs.local()[&sym];
+  if (refs.count++ == 0)
+    undef_syms.insert(&sym);
+
+  // Keep the first locations in the input order rather than the first
+  // ones we happen to see, so that the report is deterministic.
+  UndefLoc loc = {&isec, offset};
+  if (refs.locs.size() < MAX_UNDEF_LOCS) {
+    refs.locs.push_back(loc);
+    return;
+  }
+
+  auto it = std::max_element(refs.locs.begin(), refs.locs.end(), loc_less);
+  if (loc_less(loc, *it))
+    *it = loc;
+}
 
-std::string_view InputChunk::get_contents() const {
-  return file->get_string(shdr);
+// Returns true if we have seen more undefined symbols than --error-limit.
+// Beyond that, we only look for undefined symbols in the remaining
+// relocations, so that the report is the same on every run.
+bool too_many_undefined_symbols() {
+  return config.error_limit && undef_syms.size() > config.error_limit;
+}
+
+void report_undefined_symbols() {
+  if (undef_syms.empty())
+    return;
+
+  std::unordered_map<Symbol *, UndefRefs> map;
+  for (std::unordered_map<Symbol *, UndefRefs> &m : undef_refs) {
+    for (auto &[sym, refs] : m) {
+      UndefRefs &r = map[sym];
+      append(r.locs, refs.locs);
+      r.count += refs.count;
+    }
+    m.clear();
+  }
+  undef_syms.clear();
+
+  std::vector<std::pair<Symbol *, UndefRefs *>> vec;
+  for (auto &[sym, refs] : map)
+    vec.push_back({sym, &refs});
+
+  sort(vec, [](const std::pair<Symbol *, UndefRefs *> &a,
+               const std::pair<Symbol *, UndefRefs *> &b) {
+    return a.first->name < b.first->name;
+  });
+
+  i64 limit = config.error_limit ? config.error_limit : vec.size();
+
+  for (i64 i = 0; i < vec.size() && i < limit; i++) {
+    auto [sym, refs] = vec[i];
+
+    sort(refs->locs, loc_less);
+
+    Error err;
+    err << "undefined symbol: " << *refs->locs[0].isec->file << ": "
+        << sym->name;
+
+    i64 n = std::min<i64>(refs->locs.size(), MAX_UNDEF_LOCS);
+    for (i64 j = 0; j < n; j++)
+      err << "\n>>> referenced by " << refs->locs[j];
+    if (refs->count > n)
+      err << "\n>>> referenced " << (refs->count - n) << " more times";
+  }
+
+  if (vec.size() > limit)
+    Error() << "too many errors emitted, stopping now"
+            << " (use --error-limit=0 to see all errors)";
 }
 
 static std::string rel_to_string(u64 r_type) {
@@ -139,15 +386,57 @@ static void write_val(u64 r_type, u8 *loc, u64 val) {
 }
 
 void InputSection::copy_buf() {
+  copy_contents();
+  apply_reloc();
+}
+
+// Copies section contents to the output file without applying
+// relocations.
+void InputSection::copy_contents() {
   if (shdr.sh_type == SHT_NOBITS || shdr.sh_size == 0)
     return;
 
-  // Copy data
-  u8 *base = out::buf + output_section->shdr.sh_offset + offset;
-  std::string_view contents = get_contents();
-  memcpy(base, contents.data(), contents.size());
+  write_contents(out::buf + output_section->shdr.sh_offset + offset);
+}
+
+void InputSection::write_contents(u8 *base) {
+  // Compressed sections that no one has read so far are uncompressed
+  // directly into the output buffer.
+  if (contents.empty() && !compressed_contents.empty())
+    uncompress_to(*this, base);
+  else
+    memcpy(base, contents.data(), contents.size());
+}
+
+// Writes section contents with relocations applied to `base` instead
+// of the output file. This is used for non-SHF_ALLOC sections only.
+void InputSection::write_to(u8 *base) {
+  assert(!(shdr.sh_flags & SHF_ALLOC));
+  if (shdr.sh_type == SHT_NOBITS || shdr.sh_size == 0)
+    return;
+
+  write_contents(base);
+  apply_reloc_nonalloc(base);
+}
+
+// Returns a relocation at a given offset, or nullptr if the offset
+// is not relocated. Relocations are sorted by offset.
+const ElfRela *InputSection::find_rel(u64 offset) {
+  auto it = std::lower_bound(rels.begin(), rels.end(), offset,
+                             [](const ElfRela &rel, u64 offset) {
+    return rel.r_offset < offset;
+  });
+
+  if (it != rels.end() && it->r_offset == offset)
+    return &*it;
+  return nullptr;
+}
+
+void InputSection::apply_reloc() {
+  if (shdr.sh_type == SHT_NOBITS || shdr.sh_size == 0)
+    return;
 
-  // Apply relocations
+  u8 *base = out::buf + output_section->shdr.sh_offset + offset;
   if (shdr.sh_flags & SHF_ALLOC)
     apply_reloc_alloc(base);
   else
@@ -171,7 +460,7 @@ void InputSection::apply_reloc_alloc(u8 *base) {
     u8 *loc = base + rel.r_offset;
 
     const SectionFragmentRef *ref = nullptr;
-    if (has_fragments[i])
+    if (rel_info[i].has_fragment)
       ref = &rel_fragments[ref_idx++];
 
     auto write = [&](u64 val) {
@@ -186,7 +475,7 @@ void InputSection::apply_reloc_alloc(u8 *base) {
 #define G   (sym.get_got_addr() - out::got->shdr.sh_addr)
 #define GOT out::got->shdr.sh_addr
 
-    switch (rel_types[i]) {
+    switch (rel_info[i].type) {
     case R_NONE:
       break;
     case R_ABS:
@@ -259,6 +548,19 @@ void InputSection::apply_reloc_alloc(u8 *base) {
   }
 }
 
+// Records undefined symbols referred to by relocations without doing
+// anything else with them. This is used for sections written to a
+// separate debug file, which are copied after we have reported the
+// link's result, and for sections scanned after we have seen too many
+// undefined symbols.
+void InputSection::scan_undefined_symbols() {
+  for (const ElfRela &rel : rels) {
+    Symbol &sym = *file->symbols[rel.r_sym];
+    if (!sym.file || sym.is_placeholder)
+      add_undefined_symbol(*this, sym, rel.r_offset);
+  }
+}
+
 // This function is responsible for applying relocations against
 // non-SHF_ALLOC sections (i.e. sections that are not mapped to memory
 // at runtime).
@@ -282,12 +584,12 @@ void InputSection::apply_reloc_nonalloc(u8 *base) {
     Symbol &sym = *file->symbols[rel.r_sym];
 
     if (!sym.file || sym.is_placeholder) {
-      Error() << "undefined symbol: " << *file << ": " << sym.name;
+      add_undefined_symbol(*this, sym, rel.r_offset);
       continue;
     }
 
     const SectionFragmentRef *ref = nullptr;
-    if (has_fragments[i])
+    if (rel_info[i].has_fragment)
       ref = &rel_fragments[ref_idx++];
 
     u8 *loc = base + rel.r_offset;
@@ -352,6 +654,12 @@ void InputSection::scan_relocations() {
   if (!(shdr.sh_flags & SHF_ALLOC))
     return;
 
+  // The link will fail anyway, so we only collect undefined symbols.
+  if (too_many_undefined_symbols()) {
+    scan_undefined_symbols();
+    return;
+  }
+
   static Counter counter("reloc_alloc");
   counter += rels.size();
 
@@ -366,7 +674,7 @@ void InputSection::scan_relocations() {
     bool is_code = (sym.st_type == STT_FUNC);
 
     if (!sym.file || sym.is_placeholder) {
-      Error() << "undefined symbol: " << *file << ": " << sym.name;
+      add_undefined_symbol(*this, sym, rel.r_offset);
       continue;
     }
 
@@ -390,20 +698,20 @@ void InputSection::scan_relocations() {
       if (is_readonly)
         error();
       sym.flags |= NEEDS_DYNSYM;
-      rel_types[i] = R_DYN;
+      rel_info[i].type = R_DYN;
       file->num_dynrel++;
     };
 
     auto baserel = [&]() {
       if (is_readonly)
         error();
-      rel_types[i] = R_BASEREL;
+      rel_info[i].type = R_BASEREL;
       file->num_dynrel++;
     };
 
     switch (rel.r_type) {
     case R_X86_64_NONE:
-      rel_types[i] = R_NONE;
+      rel_info[i].type = R_NONE;
       break;
     case R_X86_64_8:
     case R_X86_64_16:
@@ -415,7 +723,7 @@ void InputSection::scan_relocations() {
         {  none,     error, error,         error },      // PIE
       };
 
-      rel_types[i] = R_ABS;
+      rel_info[i].type = R_ABS;
       table[output_type][get_sym_type(sym)]();
       break;
     }
@@ -426,7 +734,7 @@ void InputSection::scan_relocations() {
         {  none,     baserel, dynrel,        dynrel },     // PIE
       };
 
-      rel_types[i] = R_ABS;
+      rel_info[i].type = R_ABS;
       table[output_type][get_sym_type(sym)]();
       break;
     }
@@ -440,40 +748,40 @@ void InputSection::scan_relocations() {
         {  error,    none,  copyrel,       plt },        // PIE
       };
 
-      rel_types[i] = R_PC;
+      rel_info[i].type = R_PC;
       table[config.pic][get_sym_type(sym)]();
       break;
     }
     case R_X86_64_GOT32:
       sym.flags |= NEEDS_GOT;
-      rel_types[i] = R_GOT;
+      rel_info[i].type = R_GOT;
       break;
     case R_X86_64_GOTPC32:
       sym.flags |= NEEDS_GOT;
-      rel_types[i] = R_GOTPC;
+      rel_info[i].type = R_GOTPC;
       break;
     case R_X86_64_GOTPCREL:
     case R_X86_64_GOTPCRELX:
     case R_X86_64_REX_GOTPCRELX:
       sym.flags |= NEEDS_GOT;
-      rel_types[i] = R_GOTPCREL;
+      rel_info[i].type = R_GOTPCREL;
       break;
     case R_X86_64_PLT32:
       if (sym.is_imported || sym.st_type == STT_GNU_IFUNC)
         sym.flags |= NEEDS_PLT;
-      rel_types[i] = R_PC;
+      rel_info[i].type = R_PC;
       break;
     case R_X86_64_TLSGD:
       if (i + 1 == rels.size() || rels[i + 1].r_type != R_X86_64_PLT32)
         Error() << *this << ": TLSGD reloc not followed by PLT32";
 
       if (config.relax && !sym.is_imported) {
-        rel_types[i] = R_TLSGD_RELAX_LE;
+        rel_info[i].type = R_TLSGD_RELAX_LE;
         i++;
       } else {
         sym.flags |= NEEDS_TLSGD;
         sym.flags |= NEEDS_DYNSYM;
-        rel_types[i] = R_TLSGD;
+        rel_info[i].type = R_TLSGD;
       }
       break;
     case R_X86_64_TLSLD:
@@ -483,26 +791,26 @@ void InputSection::scan_relocations() {
         Error() << *this << ": TLSLD reloc refers external symbol " << sym.name;
 
       if (config.relax) {
-        rel_types[i] = R_TLSLD_RELAX_LE;
+        rel_info[i].type = R_TLSLD_RELAX_LE;
         i++;
       } else {
         sym.flags |= NEEDS_TLSLD;
-        rel_types[i] = R_TLSLD;
+        rel_info[i].type = R_TLSLD;
       }
       break;
     case R_X86_64_DTPOFF32:
     case R_X86_64_DTPOFF64:
       if (sym.is_imported)
         Error() << *this << ": DTPOFF reloc refers external symbol " << sym.name;
-      rel_types[i] = config.relax ? R_TPOFF : R_DTPOFF;
+      rel_info[i].type = config.relax ? R_TPOFF : R_DTPOFF;
       break;
     case R_X86_64_TPOFF32:
     case R_X86_64_TPOFF64:
-      rel_types[i] = R_TPOFF;
+      rel_info[i].type = R_TPOFF;
       break;
     case R_X86_64_GOTTPOFF:
       sym.flags |= NEEDS_GOTTPOFF;
-      rel_types[i] = R_GOTTPOFF;
+      rel_info[i].type = R_GOTTPOFF;
       break;
     default:
       Error() << *this << ": unknown relocation: " << rel.r_type;
@@ -512,6 +820,7 @@ void InputSection::scan_relocations() {
 
 void InputSection::kill() {
   is_alive = false;
+  file_stats::discarded_bytes.add(file, shdr.sh_size);
   for (FdeRecord &fde : fdes)
     fde.is_alive = false;
   file->sections[section_idx] = nullptr;
@@ -547,10 +856,13 @@ static size_t find_null(std::string_view data, u64 entsize) {
 //
 // We do not support mergeable sections that have relocations.
 MergeableSection::MergeableSection(InputSection *isec)
-  : InputChunk(isec->file, isec->shdr, isec->name),
-    parent(*MergedSection::get_instance(isec->name, isec->shdr.sh_type,
+  : InputChunk(isec->file, isec->shdr, isec->name, isec->name_info),
+    parent(*MergedSection::get_instance(isec->name_info, isec->shdr.sh_type,
                                         isec->shdr.sh_flags)) {
-  std::string_view data = isec->get_contents();
+  isec->uncompress();
+  contents = isec->get_contents();
+
+  std::string_view data = contents;
   const char *begin = data.data();
   u64 entsize = isec->shdr.sh_entsize;
 
@@ -558,6 +870,10 @@ MergeableSection::MergeableSection(InputSection *isec)
   if (isec->shdr.sh_addralign >= (1 << 16))
     Fatal() << *isec << ": alignment too large";
 
+  // Fragment offsets are stored as 32-bit deltas.
+  if (data.size() > UINT32_MAX)
+    Fatal() << *isec << ": mergeable section too large";
+
   if (isec->shdr.sh_flags & SHF_STRINGS) {
     while (!data.empty()) {
       size_t end = find_null(data, entsize);
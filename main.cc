@@ -3,6 +3,7 @@
 #include <functional>
 #include <map>
 #include <signal.h>
+#include <sys/mman.h>
 #include <tbb/global_control.h>
 #include <tbb/parallel_do.h>
 #include <tbb/parallel_for_each.h>
@@ -41,18 +42,67 @@ static FileType get_file_type(MemoryMappedFile *mb) {
   return FileType::UNKNOWN;
 }
 
+static void schedule(InputFile *file, std::function<void()> fn) {
+  if (config.numa)
+    numa_run(file->numa_node, fn);
+  else
+    parser_tg.run(fn);
+}
+
+static void schedule_parse(InputFile *file, std::function<void()> fn) {
+  if (config.numa)
+    file->numa_node = numa_assign_node(file->mb->size());
+  schedule(file, fn);
+}
+
+// With --pipelined-resolve, an object file registers its defined
+// symbols to the symbol table as soon as it is parsed, so that symbol
+// resolution overlaps with parsing of other files.
+//
+// Symbol resolution depends on file priorities, which main() assigns
+// after all files are read. We assign provisional priorities here
+// that are in the same order as the final ones (files not in archives
+// first, then archive members, each in command line order), so the
+// result is the same as resolving symbols after parsing.
+static bool is_pipelined() {
+  return config.pipelined_resolve && !preloading;
+}
+
+static void set_provisional_priority(ObjectFile *file) {
+  static u32 next[] = {2, 1 << 30};
+  file->priority = next[file->is_in_lib]++;
+}
+
 static ObjectFile *new_object_file(MemoryMappedFile *mb,
                                    std::string archive_name,
                                    ReadContext &ctx) {
   bool in_lib = (!archive_name.empty() && !ctx.whole_archive);
   ObjectFile *file = new ObjectFile(mb, archive_name, in_lib);
-  parser_tg.run([=]() { file->parse(); });
+
+  if (is_pipelined()) {
+    set_provisional_priority(file);
+    schedule_parse(file, [=]() {
+      file->parse();
+      file->resolve_symbols();
+    });
+  } else {
+    schedule_parse(file, [=]() { file->parse(); });
+  }
   return file;
 }
 
+// Adds an object file that was parsed while preloading.
+static void add_cached_object_file(ObjectFile *file) {
+  out::objs.push_back(file);
+  if (is_pipelined()) {
+    set_provisional_priority(file);
+    schedule(file, [=]() { file->resolve_symbols(); });
+  }
+}
+
 static SharedFile *new_shared_file(MemoryMappedFile *mb, bool as_needed) {
   SharedFile *file = new SharedFile(mb, as_needed);
-  parser_tg.run([=]() { file->parse(); });
+  schedule_parse(file, [=]() { file->parse(); });
   return file;
 }
 
@@ -111,7 +161,7 @@ void read_file(MemoryMappedFile *mb, ReadContext &ctx) {
   switch (get_file_type(mb)) {
   case FileType::OBJ:
     if (ObjectFile *obj = obj_cache.get_one(mb))
-      out::objs.push_back(obj);
+      add_cached_object_file(obj);
     else
       out::objs.push_back(new_object_file(mb, "", ctx));
     return;
@@ -123,7 +173,8 @@ void read_file(MemoryMappedFile *mb, ReadContext &ctx) {
     return;
   case FileType::AR:
     if (std::vector<ObjectFile *> objs = obj_cache.get(mb); !objs.empty()) {
-      append(out::objs, objs);
+      for (ObjectFile *obj : objs)
+        add_cached_object_file(obj);
     } else {
       for (MemoryMappedFile *child : read_archive_members(mb))
         out::objs.push_back(new_object_file(child, mb->name, ctx));
@@ -132,7 +183,7 @@ void read_file(MemoryMappedFile *mb, ReadContext &ctx) {
   case FileType::THIN_AR:
     for (MemoryMappedFile *child : read_thin_archive_members(mb)) {
       if (ObjectFile *obj = obj_cache.get_one(child))
-        out::objs.push_back(obj);
+        add_cached_object_file(obj);
       else
         out::objs.push_back(new_object_file(child, mb->name, ctx));
     }
@@ -162,10 +213,13 @@ static std::vector<std::span<T>> split(std::vector<T> &input, i64 unit) {
 static void resolve_symbols() {
   Timer t("resolve_symbols");
 
-  // Register defined symbols
-  tbb::parallel_for_each(out::objs, [](ObjectFile *file) {
-    file->resolve_symbols();
-  });
+  // Register defined symbols. With --pipelined-resolve, object files
+  // have already done it while being parsed.
+  if (!config.pipelined_resolve) {
+    tbb::parallel_for_each(out::objs, [](ObjectFile *file) {
+      file->resolve_symbols();
+    });
+  }
 
   tbb::parallel_for_each(out::dsos, [](SharedFile *file) {
     file->resolve_symbols();
@@ -216,10 +270,15 @@ static void handle_mergeable_strings() {
       for (SectionFragment *frag : isec->fragments) {
         if (!frag->is_alive)
           continue;
+        static LockStat stat("fragment_owner_cas");
+        LockTimer t(stat);
+
         MergeableSection *cur = frag->isec;
-        while (!cur || cur->file->priority > isec->file->priority)
+        while (!cur || cur->file->priority > isec->file->priority) {
           if (frag->isec.compare_exchange_weak(cur, isec))
             break;
+          t.retry();
+        }
       }
     }
   });
@@ -235,6 +294,9 @@ static void handle_mergeable_strings() {
           offset += frag->data.size();
         }
       }
+
+      if (offset > UINT32_MAX)
+        Fatal() << *isec << ": mergeable section too large";
       isec->size = offset;
     }
   });
@@ -247,6 +309,7 @@ static void handle_mergeable_strings() {
       isec->padding = align_to(offset, alignment) - offset;
       isec->offset = offset + isec->padding;
       isec->parent.shdr.sh_size = offset + isec->padding + isec->size;
+      isec->parent.members.push_back(isec);
 
       isec->parent.shdr.sh_addralign =
         std::max(isec->parent.shdr.sh_addralign, isec->shdr.sh_addralign);
@@ -263,7 +326,14 @@ static void handle_mergeable_strings() {
 static void bin_sections() {
   Timer t("bin_sections");
 
-  i64 unit = (out::objs.size() + 127) / 128;
+  // We estimate that binning a section costs a few nanoseconds. Files
+  // vary in the number of sections, so we use the average.
+  i64 num_sections = 0;
+  for (ObjectFile *file : out::objs)
+    num_sections += file->sections.size();
+
+  i64 unit = get_grain_size(out::objs.size(),
+                            5 * num_sections / out::objs.size() + 1);
   std::vector<std::span<ObjectFile *>> slices = split(out::objs, unit);
 
   i64 num_osec = OutputSection::instances.size();
@@ -292,23 +362,89 @@ static void bin_sections() {
   });
 }
 
+// Like undefined symbols, duplicate symbols are collected in per-thread
+// maps and reported once per symbol with a few files that define it.
 static void check_duplicate_symbols() {
   Timer t("check_dup_syms");
 
+  struct DupDefs {
+    std::vector<ObjectFile *> files;
+    i64 count = 0;
+  };
+
+  constexpr i64 MAX_DUP_LOCS = 3;
+  tbb::enumerable_thread_specific<std::unordered_map<Symbol *, DupDefs>> defs;
+
+  auto less = [](ObjectFile *a, ObjectFile *b) {
+    return a->priority < b->priority;
+  };
+
   tbb::parallel_for_each(out::objs, [&](ObjectFile *file) {
     for (i64 i = file->first_global; i < file->elf_syms.size(); i++) {
       const ElfSym &esym = file->elf_syms[i];
       Symbol &sym = *file->symbols[i];
       bool is_weak = (esym.st_bind == STB_WEAK);
       bool is_eliminated =
-        !esym.is_abs() && !esym.is_common() && !file->sections[esym.st_shndx];
+        !esym.is_abs() && !esym.is_common() && !file->get_section(esym);
 
-      if (esym.is_defined() && !is_weak && !is_eliminated && sym.file != file)
-        Error() << "duplicate symbol: " << *file << ": " << *sym.file
-                << ": " << sym.name;
+      if (!esym.is_defined() || is_weak || is_eliminated || sym.file == file)
+        continue;
+
+      // Keep the first files in the input order so that the report
+      // doesn't depend on scheduling.
+      DupDefs &d = defs.local()[&sym];
+      d.count++;
+      if (d.files.size() < MAX_DUP_LOCS) {
+        d.files.push_back(file);
+      } else {
+        auto it = std::max_element(d.files.begin(), d.files.end(), less);
+        if (less(file, *it))
+          *it = file;
+      }
+    }
+  });
+
+  std::unordered_map<Symbol *, DupDefs> map;
+  for (std::unordered_map<Symbol *, DupDefs> &m : defs) {
+    for (auto &[sym, d] : m) {
+      DupDefs &d2 = map[sym];
+      append(d2.files, d.files);
+      d2.count += d.count;
     }
+  }
+
+  if (map.empty())
+    return;
+
+  std::vector<std::pair<Symbol *, DupDefs *>> vec;
+  for (auto &[sym, d] : map)
+    vec.push_back({sym, &d});
+
+  sort(vec, [](const std::pair<Symbol *, DupDefs *> &a,
+               const std::pair<Symbol *, DupDefs *> &b) {
+    return a.first->name < b.first->name;
   });
 
+  i64 limit = config.error_limit ? config.error_limit : vec.size();
+
+  for (i64 i = 0; i < vec.size() && i < limit; i++) {
+    auto [sym, d] = vec[i];
+    sort(d->files, less);
+
+    Error err;
+    err << "duplicate symbol: " << *sym->file << ": " << sym->name;
+
+    i64 n = std::min<i64>(d->files.size(), MAX_DUP_LOCS);
+    for (i64 j = 0; j < n; j++)
+      err << "\n>>> also defined in " << *d->files[j];
+    if (d->count > n)
+      err << "\n>>> also defined in " << (d->count - n) << " more files";
+  }
+
+  if (vec.size() > limit)
+    Error() << "too many errors emitted, stopping now"
+            << " (use --error-limit=0 to see all errors)";
+
   Error::checkpoint();
 }
 
@@ -319,8 +455,14 @@ static void set_isec_offsets() {
     if (osec->members.empty())
       return;
 
-    std::vector<std::span<InputSection *>> slices = split(osec->members, 10000);
+    // We estimate that assigning an offset to a section costs a few
+    // nanoseconds.
+    std::vector<std::span<InputSection *>> slices =
+      split(osec->members, get_grain_size(osec->members.size(), 5));
     std::vector<i64> size(slices.size());
+
+    static Counter counter("isec_offset_tasks");
+    counter += slices.size();
     std::vector<i64> alignments(slices.size());
 
     tbb::parallel_for((i64)0, (i64)slices.size(), [&](i64 i) {
@@ -354,15 +496,26 @@ static void set_isec_offsets() {
   });
 }
 
-static void scan_rels() {
+static void scan_rels(tbb::task_group &early_copy_tg) {
   Timer t("scan_rels");
 
   // Scan relocations to find dynamic symbols.
-  tbb::parallel_for_each(out::objs, [&](ObjectFile *file) {
-    file->scan_relocations();
-  });
+  if (config.numa) {
+    numa_for_each_file(out::objs, [&](ObjectFile *file) {
+      file->scan_relocations();
+    });
+  } else {
+    tbb::parallel_for_each(out::objs, [&](ObjectFile *file) {
+      file->scan_relocations();
+    });
+  }
 
   // Exit if there was a relocation that refers an undefined symbol.
+  // With --early-copy, the output file may still be being written,
+  // so wait for it first.
+  report_undefined_symbols();
+  if (Error::has_errors())
+    early_copy_tg.wait();
   Error::checkpoint();
 
   // Export symbols referenced by DSOs.
@@ -523,6 +676,206 @@ static void fill_symbol_versions() {
   }
 }
 
+// Drops pages in a given range from our address space. The output file
+// and mmap'ed input files are shared or read-only file mappings, so the
+// contents are not lost and are faulted in again if they are accessed.
+static void release_pages(const void *addr, i64 size) {
+  static i64 page_size = sysconf(_SC_PAGESIZE);
+  u64 begin = (u64)addr & ~(page_size - 1);
+  u64 end = align_to((u64)addr + size, page_size);
+  if (begin < end)
+    madvise((void *)begin, end - begin, MADV_DONTNEED);
+}
+
+static void release_members(std::span<InputSection *> members) {
+  for (InputSection *isec : members) {
+    MemoryMappedFile *mb = isec->file->mb;
+    if (isec->shdr.sh_type == SHT_NOBITS || !mb->is_mmapped)
+      continue;
+
+    std::string_view data = isec->compressed_contents.empty()
+      ? isec->get_contents() : isec->compressed_contents;
+
+    // Contents rewritten by the linker (e.g. by --gc-debug-info) are
+    // not part of the mapped file, so we must not release them.
+    if (mb->data() <= (u8 *)data.data() &&
+        (u8 *)data.data() + data.size() <= mb->data() + mb->size())
+      release_pages(data.data(), data.size());
+  }
+}
+
+// With --memory-budget, SHF_ALLOC chunks are written first, and then
+// non-alloc chunks (mostly debug info) are written in batches whose
+// total size is bounded by the budget. Output pages and the input pages
+// that were read are released after each step, so that the resident
+// set doesn't grow with the size of the output.
+static void copy_chunks_with_budget() {
+  i64 batch_size = std::max<i64>(config.memory_budget / 2, 1);
+  std::vector<OutputChunk *> alloc;
+  std::vector<OutputChunk *> nonalloc;
+
+  for (OutputChunk *chunk : out::chunks) {
+    if (chunk->shdr.sh_flags & SHF_ALLOC)
+      alloc.push_back(chunk);
+    else
+      nonalloc.push_back(chunk);
+  }
+
+  auto release = [](OutputChunk *chunk) {
+    if (chunk->shdr.sh_type != SHT_NOBITS)
+      release_pages(out::buf + chunk->shdr.sh_offset, chunk->shdr.sh_size);
+    if (chunk->kind == OutputChunk::REGULAR)
+      release_members(((OutputSection *)chunk)->members);
+  };
+
+  tbb::parallel_for_each(alloc, [&](OutputChunk *chunk) {
+    chunk->copy_buf();
+  });
+  tbb::parallel_for_each(alloc, release);
+
+  for (OutputChunk *chunk : nonalloc) {
+    if (chunk->kind != OutputChunk::REGULAR) {
+      chunk->copy_buf();
+      release(chunk);
+      continue;
+    }
+
+    // Split a large output section into batches of members.
+    OutputSection *osec = (OutputSection *)chunk;
+    std::vector<InputSection *> &members = osec->members;
+
+    for (i64 i = 0; i < members.size();) {
+      i64 j = i + 1;
+      i64 size = members[i]->shdr.sh_size;
+      for (; j < members.size(); j++) {
+        if (size + members[j]->shdr.sh_size > batch_size)
+          break;
+        size += members[j]->shdr.sh_size;
+      }
+
+      osec->copy_members(i, j);
+
+      u64 begin = members[i]->offset;
+      u64 end = (j == members.size()) ? osec->shdr.sh_size : members[j]->offset;
+      release_pages(out::buf + osec->shdr.sh_offset + begin, end - begin);
+      release_members(std::span(members).subspan(i, j - i));
+      i = j;
+    }
+  }
+}
+
+static bool is_debug_chunk(OutputChunk *chunk) {
+  return !(chunk->shdr.sh_flags & SHF_ALLOC) &&
+         chunk->name.starts_with(".debug");
+}
+
+// Replaces debug sections with compressed ones. This has to be done
+// after symbol addresses are fixed, because debug info refers to them.
+// Since non-alloc sections follow all alloc sections, changing their
+// sizes doesn't move any symbol.
+static void compress_debug_sections(std::vector<OutputChunk *> &chunks) {
+  Timer t("compress_debug_sections");
+
+  std::vector<CompressedSection *> secs;
+  for (OutputChunk *&chunk : chunks) {
+    if (is_debug_chunk(chunk)) {
+      CompressedSection *sec = new CompressedSection(*chunk);
+      secs.push_back(sec);
+      chunk = sec;
+    }
+  }
+
+  // Compress shards of all sections in a single parallel loop, so that
+  // a few large sections don't serialize the work.
+  std::vector<std::pair<CompressedSection *, i64>> shards;
+  for (CompressedSection *sec : secs)
+    for (i64 i = 0; i < sec->get_num_shards(); i++)
+      shards.push_back({sec, i});
+
+  tbb::parallel_for_each(shards, [](std::pair<CompressedSection *, i64> &p) {
+    p.first->compress_shard(p.second);
+  });
+
+  for (CompressedSection *sec : secs)
+    sec->finalize();
+}
+
+// Writes debug sections to a file specified by --separate-debug-file.
+// The file consists of an ELF header, the debug sections, .shstrtab
+// and section headers, followed by four bytes to make its CRC-32 equal
+// to `crc`.
+static void write_separate_debug_file(std::vector<OutputChunk *> chunks,
+                                      u32 crc) {
+  Timer t("debug_file");
+
+  for (OutputChunk *chunk : chunks)
+    chunk->update_shdr();
+
+  if (config.compress_debug_sections != CompressKind::NONE)
+    compress_debug_sections(chunks);
+
+  std::string shstrtab(1, '\0');
+  i64 fileoff = sizeof(ElfEhdr);
+
+  for (OutputChunk *chunk : chunks) {
+    chunk->shdr.sh_name = shstrtab.size();
+    shstrtab += std::string(chunk->name) + '\0';
+    fileoff = align_to(fileoff, chunk->shdr.sh_addralign);
+    chunk->shdr.sh_offset = fileoff;
+    fileoff += chunk->shdr.sh_size;
+  }
+
+  ElfShdr shstrtab_shdr = {};
+  shstrtab_shdr.sh_name = shstrtab.size();
+  shstrtab += std::string(".shstrtab") + '\0';
+  shstrtab_shdr.sh_type = SHT_STRTAB;
+  shstrtab_shdr.sh_offset = fileoff;
+  shstrtab_shdr.sh_size = shstrtab.size();
+  shstrtab_shdr.sh_addralign = 1;
+  fileoff += shstrtab.size();
+
+  i64 shoff = align_to(fileoff, 8);
+  i64 shnum = chunks.size() + 2;
+  i64 filesize = shoff + shnum * sizeof(ElfShdr) + 4;
+
+  OutputFile *file = OutputFile::open(config.separate_debug_file, filesize);
+  out::buf = file->buf;
+
+  tbb::parallel_for_each(chunks, [&](OutputChunk *chunk) {
+    chunk->copy_buf();
+  });
+  Error::checkpoint();
+
+  memcpy(out::buf + shstrtab_shdr.sh_offset, shstrtab.data(), shstrtab.size());
+
+  ElfShdr *shdr = (ElfShdr *)(out::buf + shoff);
+  shdr[0] = {};
+  for (i64 i = 0; i < chunks.size(); i++)
+    shdr[i + 1] = chunks[i]->shdr;
+  shdr[shnum - 1] = shstrtab_shdr;
+
+  ElfEhdr &ehdr = *(ElfEhdr *)out::buf;
+  memset(&ehdr, 0, sizeof(ehdr));
+  memcpy(&ehdr.e_ident, "\177ELF", 4);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type = config.pic ? ET_DYN : ET_EXEC;
+  ehdr.e_machine = EM_X86_64;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_shoff = shoff;
+  ehdr.e_ehsize = sizeof(ElfEhdr);
+  ehdr.e_shentsize = sizeof(ElfShdr);
+  ehdr.e_shnum = shnum;
+  ehdr.e_shstrndx = shnum - 1;
+
+  u32 cur = compute_crc32(0, out::buf, filesize - 4);
+  std::vector<u8> trailer = crc32_solve(cur, crc);
+  memcpy(out::buf + filesize - 4, trailer.data(), trailer.size());
+
+  file->close();
+}
+
 static void clear_padding(i64 filesize) {
   Timer t("clear_padding");
 
@@ -538,6 +891,17 @@ static void clear_padding(i64 filesize) {
   zero(out::chunks.back(), filesize);
 }
 
+// Returns true if a chunk's size is not known until relocations are
+// scanned and dynamic symbols are exported.
+static bool is_late_chunk(OutputChunk *chunk) {
+  return chunk == out::got || chunk == out::plt || chunk == out::gotplt ||
+         chunk == out::relplt || chunk == out::reldyn ||
+         chunk == out::dynamic || chunk == out::dynsym ||
+         chunk == out::dynstr || chunk == out::hash ||
+         chunk == out::gnu_hash || chunk == out::copyrel ||
+         chunk == out::versym || chunk == out::verneed;
+}
+
 // We want to sort output sections in the following order.
 //
 // note
@@ -547,15 +911,18 @@ static void clear_padding(i64 filesize) {
 // alloc writable tbss
 // alloc writable data
 // alloc writable bss
+// alloc late (only with --early-copy; see is_late_chunk)
 // nonalloc
-static i64 get_section_rank(const ElfShdr &shdr) {
+static i64 get_section_rank(OutputChunk *chunk) {
+  const ElfShdr &shdr = chunk->shdr;
   bool note = shdr.sh_type == SHT_NOTE;
   bool alloc = shdr.sh_flags & SHF_ALLOC;
+  bool late = config.early_copy && alloc && is_late_chunk(chunk);
   bool writable = shdr.sh_flags & SHF_WRITE;
   bool exec = shdr.sh_flags & SHF_EXECINSTR;
   bool tls = shdr.sh_flags & SHF_TLS;
   bool nobits = shdr.sh_type == SHT_NOBITS;
-  return (!note << 6) | (!alloc << 5) | (writable << 4) |
+  return (!note << 7) | (!alloc << 6) | (late << 5) | (writable << 4) |
          (exec << 3) | (!tls << 2) | nobits;
 }
 
@@ -592,6 +959,45 @@ static i64 set_osec_offsets(std::span<OutputChunk *> chunks) {
   return fileoff;
 }
 
+// With --early-copy, variable-size synthetic sections such as .got or
+// .dynsym are placed after all the other SHF_ALLOC sections. Then the
+// offsets of regular output sections and merged sections don't depend
+// on relocation scanning, so we fix them before scanning relocations
+// and copy their contents to the output file while scanning. This
+// function computes that provisional layout and returns the chunks
+// whose contents can be copied early.
+static std::vector<OutputChunk *> set_provisional_osec_offsets() {
+  Timer t("provisional_layout");
+
+  auto is_fixed = [](OutputChunk *chunk) {
+    return (chunk->shdr.sh_flags & SHF_ALLOC) && !is_late_chunk(chunk);
+  };
+
+  for (OutputChunk *chunk : out::chunks)
+    if (is_fixed(chunk))
+      chunk->update_shdr();
+
+  erase(out::chunks, [&](OutputChunk *chunk) {
+    return is_fixed(chunk) && chunk->shdr.sh_size == 0;
+  });
+
+  // The program header size computed here is an upper bound of the
+  // final one, so it doesn't move the sections after it.
+  out::phdr->update_shdr();
+  set_osec_offsets(out::chunks);
+
+  std::unordered_set<OutputChunk *> merged(MergedSection::instances.begin(),
+                                           MergedSection::instances.end());
+
+  std::vector<OutputChunk *> vec;
+  for (OutputChunk *chunk : out::chunks)
+    if ((chunk->kind == OutputChunk::REGULAR || merged.contains(chunk)) &&
+        (chunk->shdr.sh_flags & SHF_ALLOC) &&
+        chunk->shdr.sh_type != SHT_NOBITS)
+      vec.push_back(chunk);
+  return vec;
+}
+
 static void fix_synthetic_symbols(std::span<OutputChunk *> chunks) {
   auto start = [](Symbol *sym, OutputChunk *chunk) {
     if (sym && chunk) {
@@ -668,7 +1074,7 @@ static void fix_synthetic_symbols(std::span<OutputChunk *> chunks) {
 
   // __start_ and __stop_ symbols
   for (OutputChunk *chunk : chunks) {
-    if (is_c_identifier(chunk->name)) {
+    if (chunk->is_c_identifier) {
       start(Symbol::intern("__start_" + std::string(chunk->name)), chunk);
       stop(Symbol::intern("__stop_" + std::string(chunk->name)), chunk);
     }
@@ -785,9 +1191,23 @@ static i64 parse_number(std::string opt, std::string_view value) {
   return std::stol(std::string(value));
 }
 
-static std::vector<std::string_view> read_response_file(std::string_view path) {
+// Parses a number with an optional K, M or G suffix.
+static i64 parse_size(std::string opt, std::string_view value) {
+  i64 shift = 0;
+  if (!value.empty()) {
+    switch (value.back()) {
+    case 'K': case 'k': shift = 10; break;
+    case 'M': case 'm': shift = 20; break;
+    case 'G': case 'g': shift = 30; break;
+    }
+  }
+  if (shift)
+    value = value.substr(0, value.size() - 1);
+  return parse_number(opt, value) << shift;
+}
+
+static std::vector<std::string_view> read_response_file(MemoryMappedFile *mb) {
   std::vector<std::string_view> vec;
-  MemoryMappedFile *mb = MemoryMappedFile::must_open(std::string(path));
 
   auto read_quoted = [&](i64 i, char quote) {
     std::string *buf = new std::string;
@@ -800,7 +1220,7 @@ static std::vector<std::string_view> read_response_file(std::string_view path) {
       }
     }
     if (i >= mb->size())
-      Fatal() << path << ": premature end of input";
+      Fatal() << mb->name << ": premature end of input";
     vec.push_back(std::string_view(*buf));
     return i + 1;
   };
@@ -831,7 +1251,7 @@ static std::vector<std::string_view> expand_response_files(char **argv) {
 
   for (i64 i = 0; argv[i]; i++) {
     if (argv[i][0] == '@')
-      append(vec, read_response_file(argv[i] + 1));
+      append(vec, read_response_file(MemoryMappedFile::must_open(argv[i] + 1)));
     else
       vec.push_back(argv[i]);
   }
@@ -842,7 +1262,10 @@ static std::vector<std::string_view> get_input_files(std::span<std::string_view>
   static std::unordered_set<std::string_view> needs_arg({
     "o", "dynamic-linker", "export-dynamic", "e", "entry", "y",
     "trace-symbol", "filler", "sysroot", "thread-count", "z",
-    "hash-style", "m", "rpath", "version-script",
+    "hash-style", "m", "rpath", "version-script", "bench", "bench-save",
+    "bench-compare", "bench-threshold", "reproduce", "replay",
+    "memory-budget", "separate-debug-file", "compress-debug-sections",
+    "Map", "error-limit", "tasks-per-thread",
   });
 
   std::vector<std::string_view> vec;
@@ -895,8 +1318,25 @@ static Config parse_nonpositional_args(std::span<std::string_view> args,
       conf.export_dynamic = true;
     } else if (read_arg(args, arg, "e") || read_arg(args, arg, "entry")) {
       conf.entry = arg;
-    } else if (read_flag(args, "print-map")) {
+    } else if (read_arg(args, arg, "separate-debug-file")) {
+      conf.separate_debug_file = arg;
+    } else if (read_arg(args, arg, "memory-budget")) {
+      conf.memory_budget = parse_size("memory-budget", arg);
+    } else if (read_flag(args, "early-copy")) {
+      conf.early_copy = true;
+    } else if (read_flag(args, "early-copy-discard")) {
+      conf.early_copy_discard = true;
+    } else if (read_flag(args, "numa")) {
+      conf.numa = true;
+    } else if (read_flag(args, "dry-run-layout")) {
+      conf.dry_run_layout = true;
+    } else if (read_flag(args, "print-map") || read_flag(args, "M")) {
+      conf.print_map = true;
+    } else if (read_arg(args, arg, "Map")) {
+      conf.map_file = arg;
       conf.print_map = true;
+    } else if (read_arg(args, arg, "error-limit")) {
+      conf.error_limit = parse_number("error-limit", arg);
     } else if (read_flag(args, "stats")) {
       conf.stats = true;
     } else if (read_flag(args, "static")) {
@@ -914,6 +1354,15 @@ static Config parse_nonpositional_args(std::span<std::string_view> args,
       conf.sysroot = arg;
     } else if (read_arg(args, arg, "u") || read_arg(args, arg, "undefined")) {
       conf.undefined.push_back(arg);
+    } else if (read_arg(args, arg, "compress-debug-sections")) {
+      if (arg == "none")
+        conf.compress_debug_sections = CompressKind::NONE;
+      else if (arg == "zlib" || arg == "zlib-gabi")
+        conf.compress_debug_sections = CompressKind::ZLIB;
+      else if (arg == "zstd")
+        conf.compress_debug_sections = CompressKind::ZSTD;
+      else
+        Fatal() << "invalid --compress-debug-sections argument: " << arg;
     } else if (read_arg(args, arg, "hash-style")) {
       if (arg == "sysv") {
         conf.hash_style_sysv = true;
@@ -929,6 +1378,8 @@ static Config parse_nonpositional_args(std::span<std::string_view> args,
       }
     } else if (read_flag(args, "allow-multiple-definition")) {
       conf.allow_multiple_definition = true;
+    } else if (read_flag(args, "time-trace-files")) {
+      conf.time_trace_files = true;
     } else if (read_flag(args, "trace")) {
       conf.trace = true;
     } else if (read_flag(args, "eh-frame-hdr")) {
@@ -945,14 +1396,32 @@ static Config parse_nonpositional_args(std::span<std::string_view> args,
       conf.relax = true;
     } else if (read_flag(args, "no-relax")) {
       conf.relax = false;
+    } else if (read_flag(args, "pipelined-resolve")) {
+      conf.pipelined_resolve = true;
     } else if (read_flag(args, "perf")) {
       conf.perf = true;
+    } else if (read_arg(args, arg, "bench")) {
+      conf.bench_runs = parse_number("bench", arg);
+    } else if (read_arg(args, arg, "bench-save")) {
+      conf.bench_save = arg;
+    } else if (read_arg(args, arg, "bench-compare")) {
+      conf.bench_compare = arg;
+    } else if (read_arg(args, arg, "bench-threshold")) {
+      conf.bench_threshold = parse_number("bench-threshold", arg);
     } else if (read_z_flag(args, "now")) {
       conf.z_now = true;
     } else if (read_flag(args, "fork")) {
       conf.fork = true;
     } else if (read_flag(args, "no-fork")) {
       conf.fork = false;
+    } else if (read_flag(args, "gdb-index")) {
+      conf.gdb_index = true;
+    } else if (read_flag(args, "no-gdb-index")) {
+      conf.gdb_index = false;
+    } else if (read_flag(args, "gc-debug-info")) {
+      conf.gc_debug_info = true;
+    } else if (read_flag(args, "no-gc-debug-info")) {
+      conf.gc_debug_info = false;
     } else if (read_flag(args, "gc-sections")) {
       conf.gc_sections = true;
     } else if (read_flag(args, "no-gc-sections")) {
@@ -973,6 +1442,10 @@ static Config parse_nonpositional_args(std::span<std::string_view> args,
       conf.quick_exit = true;
     } else if (read_flag(args, "no-quick-exit")) {
       conf.quick_exit = false;
+    } else if (read_arg(args, arg, "tasks-per-thread")) {
+      conf.tasks_per_thread = parse_number("tasks-per-thread", arg);
+      if (conf.tasks_per_thread < 1)
+        Fatal() << "invalid --tasks-per-thread argument: " << arg;
     } else if (read_arg(args, arg, "thread-count")) {
       conf.thread_count = parse_number("thread-count", arg);
     } else if (read_flag(args, "no-threads")) {
@@ -983,12 +1456,19 @@ static Config parse_nonpositional_args(std::span<std::string_view> args,
       conf.discard_locals = true;
     } else if (read_flag(args, "strip-all") || read_flag(args, "s")) {
       conf.strip_all = true;
+      conf.strip_debug = true;
+    } else if (read_flag(args, "strip-debug") || read_flag(args, "S")) {
+      conf.strip_debug = true;
     } else if (read_arg(args, arg, "rpath")) {
       if (!conf.rpaths.empty())
         conf.rpaths += ":";
       conf.rpaths += arg;
     } else if (read_arg(args, arg, "version-script")) {
       conf.version_script.push_back(arg);
+    } else if (read_arg(args, arg, "reproduce")) {
+      conf.reproduce = arg;
+    } else if (read_arg(args, arg, "replay")) {
+      conf.replay = arg;
     } else if (read_flag(args, "build-id")) {
       conf.build_id = BuildIdKind::SHA256;
     } else if (read_arg(args, arg, "build-id")) {
@@ -1055,7 +1535,84 @@ static void read_input_files(std::span<std::string_view> args) {
       args = args.subspan(1);
     }
   }
+
   parser_tg.wait();
+  if (config.numa)
+    numa_wait();
+}
+
+static std::string quote(std::string_view str) {
+  std::string ret = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      ret += '\\';
+    ret += c;
+  }
+  return ret + "\"";
+}
+
+// Writes a tar file for --reproduce. The tar file contains all input
+// files with their absolute paths, the command line and the current
+// directory, so that the link can be reproduced by --replay.
+static void write_repro_file(std::span<std::string_view> args) {
+  std::string basedir = path_filename(config.reproduce);
+  if (basedir.ends_with(".tar"))
+    basedir = basedir.substr(0, basedir.size() - 4);
+
+  TarWriter tar(config.reproduce, basedir);
+  std::string cwd = get_current_dir();
+
+  // The output file is created in the current directory on replay.
+  std::stringstream ss;
+  while (!args.empty()) {
+    std::string_view arg;
+    if (read_arg(args, arg, "o") || read_arg(args, arg, "reproduce"))
+      continue;
+    ss << quote(args[0]) << "\n";
+    args = args.subspan(1);
+  }
+  ss << "-o\n" << quote(path_filename(config.output)) << "\n";
+
+  tar.append("response.txt", ss.str());
+  tar.append("cwd.txt", cwd);
+
+  std::unordered_set<std::string> seen;
+  for (MemoryMappedFile *mb : MemoryMappedFile::opened_files) {
+    std::string path = path_to_absolute(mb->name, cwd);
+    if (seen.insert(path).second)
+      tar.append(path.substr(1), mb->get_contents());
+  }
+}
+
+// Reads a tar file created by --reproduce and returns the captured
+// command line followed by options given to the current process.
+// Input files are read from the tar file from now on.
+static std::vector<std::string_view>
+read_repro_file(std::span<std::string_view> args) {
+  MemoryMappedFile *mb = MemoryMappedFile::must_open(config.replay);
+  MemoryMappedFile *response = nullptr;
+
+  for (auto [name, file] : read_tar(mb)) {
+    if (name == "response.txt")
+      response = file;
+    else if (name == "cwd.txt")
+      MemoryMappedFile::replay_cwd = file->get_contents();
+    else
+      MemoryMappedFile::replay_files["/" + name] = file;
+  }
+
+  if (!response || MemoryMappedFile::replay_cwd.empty())
+    Fatal() << config.replay << ": not a file created by --reproduce";
+
+  std::vector<std::string_view> vec = read_response_file(response);
+  while (!args.empty()) {
+    std::string_view arg;
+    if (read_arg(args, arg, "replay"))
+      continue;
+    vec.push_back(args[0]);
+    args = args.subspan(1);
+  }
+  return vec;
 }
 
 static void show_stats() {
@@ -1078,6 +1635,29 @@ static void show_stats() {
   Counter::print();
 }
 
+static int finish(std::function<void()> on_complete) {
+  // Show stats numbers
+  if (config.stats)
+    show_stats();
+
+  if (config.perf) {
+    Timer::print();
+    LockStat::print();
+  }
+
+  if (config.time_trace_files)
+    print_file_stats();
+
+  std::cout << std::flush;
+  std::cerr << std::flush;
+  if (on_complete)
+    on_complete();
+
+  if (config.quick_exit)
+    std::quick_exit(0);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   Timer t_all("all");
 
@@ -1086,6 +1666,12 @@ int main(int argc, char **argv) {
   std::vector<std::string_view> file_args;
   config = parse_nonpositional_args(arg_vector, file_args);
 
+  if (!config.replay.empty()) {
+    arg_vector = read_repro_file(arg_vector);
+    file_args.clear();
+    config = parse_nonpositional_args(arg_vector, file_args);
+  }
+
   if (config.output == "")
     Fatal() << "-o option is missing";
 
@@ -1096,6 +1682,9 @@ int main(int argc, char **argv) {
   tbb::global_control tbb_cont(tbb::global_control::max_allowed_parallelism,
                                config.thread_count);
 
+  if (config.numa)
+    numa_init();
+
   signal(SIGINT, signal_handler);
   signal(SIGTERM, signal_handler);
 
@@ -1108,6 +1697,8 @@ int main(int argc, char **argv) {
     preloading = true;
     read_input_files(file_args);
     wait_for_client();
+  } else if (config.bench_runs > 0) {
+    on_complete = run_benchmark();
   } else if (config.fork) {
     on_complete = fork_child();
   }
@@ -1128,6 +1719,9 @@ int main(int argc, char **argv) {
     read_input_files(file_args);
   }
 
+  if (!config.reproduce.empty())
+    write_repro_file(arg_vector);
+
   // Uniquify shared object files with soname
   {
     std::vector<SharedFile *> vec;
@@ -1195,6 +1789,9 @@ int main(int argc, char **argv) {
   out::chunks.push_back(out::buildid);
 
   // Set priorities to files. File priority 1 is reserved for the internal file.
+  // With --pipelined-resolve, object files already have provisional
+  // priorities in the same order, so overwriting them doesn't change
+  // the result of symbol resolution.
   i64 priority = 2;
   for (ObjectFile *file : out::objs)
     if (!file->is_in_lib)
@@ -1235,6 +1832,10 @@ int main(int argc, char **argv) {
   if (config.icf)
     icf_sections();
 
+  // Remove debug info for discarded sections.
+  if (config.gc_debug_info)
+    gc_debug_info();
+
   // Merge string constants in SHF_MERGE sections.
   handle_mergeable_strings();
 
@@ -1267,7 +1868,7 @@ int main(int argc, char **argv) {
   // Sort the sections by section flags so that we'll have to create
   // as few segments as possible.
   sort(out::chunks, [](OutputChunk *a, OutputChunk *b) {
-    return get_section_rank(a->shdr) < get_section_rank(b->shdr);
+    return get_section_rank(a) < get_section_rank(b);
   });
 
   // Create a dummy file containing linker-synthesized symbols
@@ -1305,9 +1906,56 @@ int main(int argc, char **argv) {
     out::chunks.insert(out::chunks.begin() + 2, out::interp);
   out::chunks.push_back(out::shdr);
 
+  // .eh_frame is a special section from the linker's point of view,
+  // as it's contents are parsed, consumed and reconstructed by the
+  // linker, unlike other sections that consist of just opaque bytes.
+  // Here, we transplant .eh_frame sections from a regular output
+  // section to the special EHFrameSection.
+  {
+    Timer t("eh_frame");
+    erase(out::chunks, [](OutputChunk *chunk) {
+      return chunk->kind == OutputChunk::REGULAR && chunk->name == ".eh_frame";
+    });
+    out::eh_frame->construct();
+  }
+
+  // With --early-copy, create an output file and start copying section
+  // contents whose offsets are already fixed. Relocations are applied
+  // later, after the final layout is computed.
+  OutputFile *file = nullptr;
+  std::vector<std::pair<OutputChunk *, u64>> early_chunks;
+  tbb::task_group early_copy_tg;
+
+  if (config.early_copy && !config.dry_run_layout && !config.memory_budget) {
+    std::vector<OutputChunk *> chunks = set_provisional_osec_offsets();
+
+    i64 size = 0;
+    for (OutputChunk *chunk : chunks) {
+      early_chunks.push_back({chunk, chunk->shdr.sh_offset});
+      size = std::max<i64>(size, chunk->shdr.sh_offset + chunk->shdr.sh_size);
+    }
+
+    if (size) {
+      // We don't overwrite an existing file in place, as we may still
+      // fail to link, e.g. because of undefined symbols.
+      file = OutputFile::open(config.output, size, false);
+      out::buf = file->buf;
+
+      static Counter counter("early_copied_chunks");
+      counter += chunks.size();
+
+      early_copy_tg.run([=] {
+        tbb::parallel_for_each(chunks, [](OutputChunk *chunk) {
+          chunk->copy_contents();
+          chunk->contents_copied = true;
+        });
+      });
+    }
+  }
+
   // Scan relocations to find symbols that need entries in .got, .plt,
   // .got.plt, .dynsym, .dynstr, etc.
-  scan_rels();
+  scan_rels(early_copy_tg);
 
   // Put symbols to .dynsym.
   export_dynamic();
@@ -1327,19 +1975,30 @@ int main(int argc, char **argv) {
     });
   }
 
-  // .eh_frame is a special section from the linker's point of view,
-  // as it's contents are parsed, consumed and reconstructed by the
-  // linker, unlike other sections that consist of just opaque bytes.
-  // Here, we transplant .eh_frame sections from a regular output
-  // section to the special EHFrameSection.
-  {
-    Timer t("eh_frame");
-    erase(out::chunks, [](OutputChunk *chunk) {
-      return chunk->kind == OutputChunk::REGULAR && chunk->name == ".eh_frame";
-    });
-    out::eh_frame->construct();
+  // Create .gdb_index from debug info sections.
+  if (config.gdb_index) {
+    out::gdb_index = new GdbIndexSection;
+    out::gdb_index->construct();
+    out::chunks.insert(out::chunks.end() - 1, out::gdb_index);
+  }
+
+  // If --separate-debug-file is given, debug sections are written to
+  // another file, and .gnu_debuglink is added to refer to it.
+  std::vector<OutputChunk *> debug_chunks;
+  if (!config.separate_debug_file.empty()) {
+    for (OutputChunk *chunk : out::chunks)
+      if (is_debug_chunk(chunk))
+        debug_chunks.push_back(chunk);
+    erase(out::chunks, is_debug_chunk);
+
+    out::gnu_debuglink = new GnuDebuglinkSection;
+    out::chunks.insert(out::chunks.end() - 1, out::gnu_debuglink);
   }
 
+  // Section headers are updated below, so the early copy, which reads
+  // them, must be done by now.
+  early_copy_tg.wait();
+
   // Now that we have computed sizes for all sections and assigned
   // section indices to them, so we can fix section header contents
   // for all output sections.
@@ -1348,6 +2007,21 @@ int main(int argc, char **argv) {
 
   erase(out::chunks, [](OutputChunk *c) { return c->shdr.sh_size == 0; });
 
+  // If we have too many sections for the 16-bit st_shndx field,
+  // create .symtab_shndx to store section indices of symbols.
+  if (out::symtab) {
+    i64 shnum = 2;
+    for (OutputChunk *chunk : out::chunks)
+      if (chunk->kind != OutputChunk::HEADER)
+        shnum++;
+
+    if (shnum >= SHN_LORESERVE) {
+      out::symtab_shndx = new SymtabShndxSection;
+      auto it = std::find(out::chunks.begin(), out::chunks.end(), out::symtab);
+      out::chunks.insert(it + 1, out::symtab_shndx);
+    }
+  }
+
   // Set section indices.
   for (i64 i = 0, shndx = 1; i < out::chunks.size(); i++)
     if (out::chunks[i]->kind != OutputChunk::HEADER)
@@ -1376,54 +2050,111 @@ int main(int argc, char **argv) {
     }
   }
 
+  // Compress debug sections and recompute the file layout.
+  if (config.compress_debug_sections != CompressKind::NONE) {
+    compress_debug_sections(out::chunks);
+    filesize = set_osec_offsets(out::chunks);
+  }
+
+  // The provisional layout should match the final one. If it
+  // doesn't, we discard the contents copied early. The hidden
+  // --early-copy-discard option forces this to test that path.
+  if (!early_chunks.empty()) {
+    bool discard = config.early_copy_discard;
+    for (auto [chunk, offset] : early_chunks)
+      if (chunk->shdr.sh_offset != offset)
+        discard = true;
+
+    if (discard) {
+      for (auto &pair : early_chunks)
+        pair.first->contents_copied = false;
+
+      static Counter counter("early_copy_discarded_chunks");
+      counter += early_chunks.size();
+    }
+  }
+
   t_before_copy.stop();
 
-  // Create an output file
-  OutputFile *file = OutputFile::open(config.output, filesize);
+  // If --dry-run-layout is given, we are done.
+  if (config.dry_run_layout) {
+    t_total.stop();
+    t_all.stop();
+
+    print_layout(filesize);
+    if (config.print_map)
+      print_map();
+    return finish(on_complete);
+  }
+
+  // Create an output file. With --early-copy, it already exists,
+  // so we extend it to the final size.
+  if (file)
+    file->resize(filesize);
+  else
+    file = OutputFile::open(config.output, filesize);
   out::buf = file->buf;
 
   Timer t_copy("copy");
 
+  // A map file depends only on the file layout, so we write it while
+  // copying sections to the output file.
+  tbb::task_group map_tg;
+  if (config.print_map)
+    map_tg.run(print_map);
+
   // Copy input sections to the output file
   {
     Timer t("copy_buf");
-    tbb::parallel_for_each(out::chunks, [&](OutputChunk *chunk) {
-      chunk->copy_buf();
-    });
+    if (config.memory_budget) {
+      copy_chunks_with_budget();
+    } else {
+      tbb::parallel_for_each(out::chunks, [&](OutputChunk *chunk) {
+        chunk->copy_buf();
+      });
+    }
+
+    // Debug sections for --separate-debug-file are written after we
+    // signal completion, so check their relocations now.
+    for (OutputChunk *chunk : debug_chunks)
+      if (chunk->kind == OutputChunk::REGULAR)
+        tbb::parallel_for_each(((OutputSection *)chunk)->members,
+                               [](InputSection *isec) {
+          isec->scan_undefined_symbols();
+        });
+
+    report_undefined_symbols();
     Error::checkpoint();
   }
 
   // Zero-clear paddings between sections
   clear_padding(filesize);
 
+  if (out::gnu_debuglink)
+    out::gnu_debuglink->write_crc(filesize);
+
   // Commit
   if (out::buildid) {
     Timer t("build_id");
     out::buildid->write_buildid(filesize);
   }
 
+  map_tg.wait();
   file->close();
 
+  // The main output file is now complete. Let the caller proceed while
+  // we are writing debug info to a separate file.
+  if (!debug_chunks.empty()) {
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    if (on_complete)
+      on_complete();
+    on_complete = nullptr;
+    write_separate_debug_file(debug_chunks, out::gnu_debuglink->crc);
+  }
+
   t_copy.stop();
   t_total.stop();
   t_all.stop();
-
-  if (config.print_map)
-    print_map();
-
-  // Show stats numbers
-  if (config.stats)
-    show_stats();
-
-  if (config.perf)
-    Timer::print();
-
-  std::cout << std::flush;
-  std::cerr << std::flush;
-  if (on_complete)
-    on_complete();
-
-  if (config.quick_exit)
-    std::quick_exit(0);
-  return 0;
+  return finish(on_complete);
 }
@@ -1,47 +1,167 @@
 #include "mold.h"
 
+#include <fstream>
 #include <iomanip>
 #include <ios>
-#include <unordered_map>
+#include <sstream>
+#include <tbb/concurrent_hash_map.h>
+#include <tbb/parallel_for_each.h>
 
-void print_map() {
-  // Construct a section-to-symbol map.
-  std::unordered_map<InputChunk *, std::vector<Symbol *>> map;
-  for (ObjectFile *file : out::objs)
-    for (Symbol *sym : file->symbols)
-      if (sym->file == file && sym->input_section)
-        map[sym->input_section].push_back(sym);
-
-  for (auto &pair : map) {
-    std::vector<Symbol *> &vec = pair.second;
-    sort(vec, [](Symbol *a, Symbol *b) { return a->value < b->value; });
+// Symbols are collected in parallel, so we record each symbol's index
+// in its file to print aliases in a deterministic order.
+struct MapSymbol {
+  Symbol *sym;
+  i64 idx;
+};
+
+typedef tbb::concurrent_hash_map<InputChunk *, std::vector<MapSymbol>> SymbolMap;
+
+// Output sections are formatted in slices of this many members.
+static constexpr i64 SLICE_SIZE = 10000;
+
+struct MapSlice {
+  OutputChunk *chunk;
+  i64 begin;
+  i64 end;
+};
+
+static void get_symbol_map(SymbolMap &map) {
+  tbb::parallel_for_each(out::objs, [&](ObjectFile *file) {
+    for (i64 i = 0; i < file->symbols.size(); i++) {
+      Symbol *sym = file->symbols[i];
+      if (sym->file == file && sym->input_section) {
+        SymbolMap::accessor acc;
+        map.insert(acc, sym->input_section);
+        acc->second.push_back({sym, i});
+      }
+    }
+  });
+}
+
+static std::string format_slice(SymbolMap &map, MapSlice &slice) {
+  std::ostringstream out;
+  OutputChunk *osec = slice.chunk;
+
+  if (slice.begin == 0)
+    out << std::setw(16) << (u64)osec->shdr.sh_addr
+        << std::setw(9) << (u64)osec->shdr.sh_size
+        << std::setw(6) << (u64)osec->shdr.sh_addralign
+        << " " << osec->name << "\n";
+
+  if (osec->kind != OutputChunk::REGULAR)
+    return out.str();
+
+  std::span<InputSection *> members = ((OutputSection *)osec)->members;
+
+  for (InputChunk *mem : members.subspan(slice.begin, slice.end - slice.begin)) {
+    out << std::setw(16) << (osec->shdr.sh_addr + mem->offset)
+        << std::setw(9) << (u64)mem->shdr.sh_size
+        << std::setw(6) << (u64)mem->shdr.sh_addralign
+        << "         " << *mem << "\n";
+
+    SymbolMap::const_accessor acc;
+    if (!map.find(acc, mem))
+      continue;
+
+    std::vector<MapSymbol> syms = acc->second;
+    sort(syms, [](const MapSymbol &a, const MapSymbol &b) {
+      return std::tuple(a.sym->value, a.sym->file->priority, a.idx) <
+             std::tuple(b.sym->value, b.sym->file->priority, b.idx);
+    });
+
+    for (MapSymbol &ent : syms)
+      out << std::setw(16) << ent.sym->get_addr()
+          << "        0     0                 "
+          << ent.sym->name << "\n";
   }
+  return out.str();
+}
 
-  std::cout << "             VMA     Size Align Out     In      Symbol\n";
+// Prints a map file to stdout or to a file given by -Map. Output
+// sections are formatted in parallel into separate buffers, which are
+// then written out in order. This depends only on the file layout,
+// so it can run in parallel with copying sections to the output.
+void print_map() {
+  SymbolMap map;
+  get_symbol_map(map);
+
+  std::vector<MapSlice> slices;
   for (OutputChunk *osec : out::chunks) {
-    std::cout << std::setw(16) << (u64)osec->shdr.sh_addr
-              << std::setw(9) << (u64)osec->shdr.sh_size
-              << std::setw(6) << (u64)osec->shdr.sh_addralign
-              << " " << osec->name << "\n";
+    i64 size = 0;
+    if (osec->kind == OutputChunk::REGULAR)
+      size = ((OutputSection *)osec)->members.size();
 
-    if (osec->kind != OutputChunk::REGULAR)
-      continue;
+    i64 i = 0;
+    do {
+      slices.push_back({osec, i, std::min(i + SLICE_SIZE, size)});
+      i += SLICE_SIZE;
+    } while (i < size);
+  }
 
-    for (InputChunk *mem : ((OutputSection *)osec)->members) {
-      std::cout << std::setw(16) << (osec->shdr.sh_addr + mem->offset)
-                << std::setw(9) << (u64)mem->shdr.sh_size
-                << std::setw(6) << (u64)mem->shdr.sh_addralign
-                << "         " << *mem << "\n";
-
-      auto it = map.find(mem);
-      if (it == map.end())
-        continue;
-
-      std::vector<Symbol *> syms = it->second;
-      for (Symbol *sym : syms)
-        std::cout << std::setw(16) << sym->get_addr()
-                  << "        0     0                 "
-                  << sym->name << "\n";
-    }
+  std::vector<std::string> bufs(slices.size());
+  tbb::parallel_for((i64)0, (i64)slices.size(), [&](i64 i) {
+    bufs[i] = format_slice(map, slices[i]);
+  });
+
+  auto write = [&](std::ostream &out) {
+    out << "             VMA     Size Align Out     In      Symbol\n";
+    for (std::string &buf : bufs)
+      out << buf;
+  };
+
+  if (config.map_file.empty()) {
+    write(std::cout);
+    return;
   }
+
+  std::ofstream out(config.map_file);
+  if (!out)
+    Fatal() << "cannot open " << config.map_file << ": " << strerror(errno);
+  write(out);
+}
+
+static std::string_view phdr_type_to_string(u32 type) {
+  switch (type) {
+  case PT_LOAD: return "LOAD";
+  case PT_DYNAMIC: return "DYNAMIC";
+  case PT_INTERP: return "INTERP";
+  case PT_NOTE: return "NOTE";
+  case PT_PHDR: return "PHDR";
+  case PT_TLS: return "TLS";
+  case PT_GNU_EH_FRAME: return "GNU_EH_FRAME";
+  case PT_GNU_STACK: return "GNU_STACK";
+  }
+  return "UNKNOWN";
+}
+
+// Prints output sections and segments for --dry-run-layout.
+void print_layout(i64 filesize) {
+  std::cout << "Sections:\n"
+            << "             VMA           Offset     Size Align Name\n";
+
+  for (OutputChunk *chunk : out::chunks)
+    if (chunk->kind != OutputChunk::HEADER)
+      std::cout << std::setw(16) << (u64)chunk->shdr.sh_addr
+                << std::setw(17) << (u64)chunk->shdr.sh_offset
+                << std::setw(9) << (u64)chunk->shdr.sh_size
+                << std::setw(6) << (u64)chunk->shdr.sh_addralign
+                << " " << chunk->name << "\n";
+
+  std::cout << "\nSegments:\n"
+            << "Type                   VMA           Offset   FileSz    MemSz"
+            << " Flg Align\n";
+
+  for (ElfPhdr &phdr : create_phdr())
+    std::cout << std::setw(12) << std::left << phdr_type_to_string(phdr.p_type)
+              << std::right
+              << std::setw(16) << (u64)phdr.p_vaddr
+              << std::setw(17) << (u64)phdr.p_offset
+              << std::setw(9) << (u64)phdr.p_filesz
+              << std::setw(9) << (u64)phdr.p_memsz << " "
+              << ((phdr.p_flags & PF_R) ? 'R' : ' ')
+              << ((phdr.p_flags & PF_W) ? 'W' : ' ')
+              << ((phdr.p_flags & PF_X) ? 'E' : ' ')
+              << std::setw(6) << (u64)phdr.p_align << "\n";
+
+  std::cout << "\nFile size: " << filesize << "\n";
 }
@@ -9,6 +9,7 @@
 #include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <map>
@@ -51,23 +52,32 @@ class SharedFile;
 class Symbol;
 
 enum class BuildIdKind : u8 { NONE, MD5, SHA1, SHA256, UUID };
+enum class CompressKind : u8 { NONE, ZLIB, ZSTD };
 
 struct Config {
   BuildIdKind build_id = BuildIdKind::NONE;
+  CompressKind compress_debug_sections = CompressKind::NONE;
   bool allow_multiple_definition = false;
   bool discard_all = false;
   bool discard_locals = false;
+  bool dry_run_layout = false;
+  bool early_copy = false;
+  bool early_copy_discard = false;
   bool eh_frame_hdr = true;
   bool export_dynamic = false;
   bool fork = true;
+  bool gc_debug_info = false;
   bool gc_sections = false;
+  bool gdb_index = false;
   bool hash_style_gnu = false;
   bool hash_style_sysv = true;
   bool icf = false;
   bool is_static = false;
+  bool numa = false;
   bool perf = false;
   bool pic = false;
   bool pie = false;
+  bool pipelined_resolve = false;
   bool preload = false;
   bool print_gc_sections = false;
   bool print_icf_sections = false;
@@ -77,14 +87,27 @@ struct Config {
   bool shared = false;
   bool stats = false;
   bool strip_all = false;
+  bool strip_debug = false;
+  bool time_trace_files = false;
   bool trace = false;
   bool z_now = false;
+  i64 bench_runs = 0;
+  i64 bench_threshold = 10;
+  i64 error_limit = 20;
   i64 filler = -1;
+  i64 memory_budget = 0;
+  i64 tasks_per_thread = 8;
   i64 thread_count = -1;
+  std::string bench_compare;
+  std::string bench_save;
   std::string dynamic_linker = "/lib64/ld-linux-x86-64.so.2";
   std::string entry = "_start";
+  std::string map_file;
   std::string output;
+  std::string replay;
+  std::string reproduce;
   std::string rpaths;
+  std::string separate_debug_file;
   std::string sysroot;
   std::vector<std::string> globals;
   std::vector<std::string_view> library_paths;
@@ -98,13 +121,142 @@ inline Config config;
 
 void cleanup();
 
+//
+// Lock contention profiler
+//
+
+i64 now_nsec();
+
+// LockStat counts acquisitions, contended acquisitions and time spent
+// waiting at a synchronization point. It is compiled in only if mold
+// is built with `make LOCK_STATS=1`, and results are shown with --perf.
+#ifdef LOCK_STATS
+class LockStat {
+public:
+  LockStat(std::string_view name) : name(name) {
+    static std::mutex mu;
+    std::lock_guard lock(mu);
+    instances.push_back(this);
+  }
+
+  void add(bool contended, i64 wait, i64 retries = 0) {
+    Value &val = values.local();
+    val.acquired++;
+    val.contended += contended;
+    val.wait += wait;
+    val.retries += retries;
+  }
+
+  static void print();
+
+private:
+  struct Value {
+    i64 acquired = 0;
+    i64 contended = 0;
+    i64 wait = 0;
+    i64 retries = 0;
+  };
+
+  std::string_view name;
+  tbb::enumerable_thread_specific<Value> values;
+
+  static inline std::vector<LockStat *> instances;
+};
+#else
+class LockStat {
+public:
+  LockStat(std::string_view name) {}
+  void add(bool contended, i64 wait, i64 retries = 0) {}
+  static void print() {}
+};
+#endif
+
+// Locks a mutex exclusively for the current scope. Contention is
+// detected by a failed try_lock().
+template <typename Mutex>
+class LockGuard {
+public:
+  LockGuard(Mutex &mu, LockStat &stat) : mu(mu) {
+#ifdef LOCK_STATS
+    if (mu.try_lock()) {
+      stat.add(false, 0);
+      return;
+    }
+    i64 start = now_nsec();
+    mu.lock();
+    stat.add(true, now_nsec() - start);
+#else
+    mu.lock();
+#endif
+  }
+
+  ~LockGuard() { mu.unlock(); }
+
+private:
+  Mutex &mu;
+};
+
+template <typename Mutex>
+class SharedLockGuard {
+public:
+  SharedLockGuard(Mutex &mu, LockStat &stat) : mu(mu) {
+#ifdef LOCK_STATS
+    if (mu.try_lock_shared()) {
+      stat.add(false, 0);
+      return;
+    }
+    i64 start = now_nsec();
+    mu.lock_shared();
+    stat.add(true, now_nsec() - start);
+#else
+    mu.lock_shared();
+#endif
+  }
+
+  ~SharedLockGuard() { mu.unlock_shared(); }
+
+private:
+  Mutex &mu;
+};
+
+// Records time spent in a scope as wait time. This is for lock-free
+// update loops, whose failed attempts are counted by retry(), and for
+// concurrent_hash_map operations, whose internal locks are not visible
+// to us.
+class LockTimer {
+public:
+  LockTimer(LockStat &stat) : stat(stat) {
+#ifdef LOCK_STATS
+    start = now_nsec();
+#endif
+  }
+
+  ~LockTimer() {
+#ifdef LOCK_STATS
+    stat.add(retries > 0, now_nsec() - start, retries);
+#endif
+  }
+
+  void retry() {
+#ifdef LOCK_STATS
+    retries++;
+#endif
+  }
+
+private:
+  LockStat &stat;
+  i64 start = 0;
+  i64 retries = 0;
+};
+
 class SyncOut {
 public:
   SyncOut(std::ostream &out = std::cout) : out(out) {}
 
   ~SyncOut() {
     static std::mutex mu;
-    std::lock_guard lock(mu);
+    static LockStat stat("sync_out");
+    LockGuard lock(mu, stat);
     out << ss.str() << "\n";
   }
 
@@ -129,6 +281,10 @@ public:
     return *this;
   }
 
+  static bool has_errors() {
+    return has_error;
+  }
+
   static void checkpoint() {
     if (!has_error)
       return;
@@ -182,6 +338,8 @@ template<> struct tbb_hash_compare<std::string_view> {
 template<typename ValueT> class ConcurrentMap {
 public:
   ValueT *insert(std::string_view key, const ValueT &val) {
+    static LockStat stat("concurrent_map_insert");
+    LockTimer t(stat);
     typename decltype(map)::const_accessor acc;
     map.insert(acc, std::make_pair(key, val));
     return const_cast<ValueT *>(&acc->second);
@@ -190,6 +348,69 @@ public:
   tbb::concurrent_hash_map<std::string_view, ValueT> map;
 };
 
+//
+// Arena
+//
+
+// Symbols and input sections are allocated in global arenas and are
+// referred to by 32-bit IDs from per-file tables. An ID table is half
+// the size of a pointer table, and IDs don't depend on where objects
+// are placed in memory.
+
+template <typename T> class Arena;
+
+template <typename T> class Handle {
+public:
+  Handle() = default;
+  Handle(std::nullptr_t) {}
+  explicit Handle(u32 id) : id(id) {}
+
+  T &operator*() const { return Arena<T>::get(id); }
+  T *operator->() const { return &Arena<T>::get(id); }
+  operator T *() const { return id ? &Arena<T>::get(id) : nullptr; }
+
+  u32 id = 0;
+};
+
+template <typename T> class Arena {
+public:
+  static constexpr i64 CHUNK_BITS = 16;
+  static constexpr i64 CHUNK_SIZE = 1 << CHUNK_BITS;
+
+  // Reserves `n` consecutive IDs and returns the first one. Objects
+  // are constructed by the caller. ID 0 is reserved for null.
+  static u32 alloc(i64 n) {
+    u64 id = next.fetch_add(n);
+    if (id + n > UINT32_MAX)
+      Fatal() << "too many objects";
+
+    for (i64 i = id >> CHUNK_BITS; i <= (id + n - 1) >> CHUNK_BITS; i++) {
+      if (chunks[i].load(std::memory_order_acquire))
+        continue;
+      T *chunk = (T *)::operator new(sizeof(T) * CHUNK_SIZE);
+      T *expected = nullptr;
+      if (!chunks[i].compare_exchange_strong(expected, chunk))
+        ::operator delete(chunk);
+    }
+    return id;
+  }
+
+  template <typename... Args> static Handle<T> create(Args &&...args) {
+    u32 id = alloc(1);
+    new (&get(id)) T(std::forward<Args>(args)...);
+    return Handle<T>(id);
+  }
+
+  static T &get(u32 id) {
+    T *chunk = chunks[id >> CHUNK_BITS].load(std::memory_order_relaxed);
+    return chunk[id & (CHUNK_SIZE - 1)];
+  }
+
+private:
+  static inline std::atomic_uint64_t next = 1;
+  static inline std::atomic<T *> chunks[1 << (32 - CHUNK_BITS)];
+};
+
 //
 // Symbol
 //
@@ -204,6 +425,8 @@ struct SectionFragment {
 
   std::atomic<MergeableSection *> isec = nullptr;
   std::string_view data;
+
+  // Relative to the owning MergeableSection's offset, which is 64-bit.
   u32 offset = -1;
   u16 alignment = 1;
   std::atomic_bool is_alive = !config.gc_sections;
@@ -247,9 +470,21 @@ public:
   Symbol(std::string_view name) : name(name) {}
   Symbol(const Symbol &other) : name(other.name) {}
 
-  static Symbol *intern(std::string_view name) {
-    static ConcurrentMap<Symbol> map;
-    return map.insert(name, {name});
+  static Handle<Symbol> intern(std::string_view name) {
+    static tbb::concurrent_hash_map<std::string_view, u32> map;
+    static LockStat stat("concurrent_map_insert");
+    LockTimer t(stat);
+
+    {
+      decltype(map)::const_accessor acc;
+      if (map.find(acc, name))
+        return Handle<Symbol>(acc->second);
+    }
+
+    decltype(map)::accessor acc;
+    if (map.insert(acc, name))
+      acc->second = Arena<Symbol>::create(name).id;
+    return Handle<Symbol>(acc->second);
   }
 
   inline u64 get_addr() const;
@@ -276,7 +511,7 @@ public:
   u32 tlsgd_idx = -1;
   u32 plt_idx = -1;
   u32 dynsym_idx = -1;
-  u16 shndx = 0;
+  u32 shndx = 0;
   u16 ver_idx = 0;
 
   std::atomic_uint8_t flags = 0;
@@ -298,21 +533,41 @@ public:
 // input_sections.cc
 //
 
+// Input section names are interned, and properties that depend only
+// on a section name are computed once for each unique name.
+struct SectionNameInfo {
+  static const SectionNameInfo *get(std::string_view name);
+
+  std::string_view output_name;
+  bool is_c_identifier = false;
+  bool is_init = false;
+  bool is_fini = false;
+  bool is_init_fini = false;
+  bool is_relro = false;
+
+  // Output sections that sections of this name were last mapped to.
+  mutable std::atomic<OutputSection *> output_section = nullptr;
+  mutable std::atomic<MergedSection *> merged_section = nullptr;
+};
+
 class InputChunk {
 public:
   virtual void copy_buf() {}
   inline u64 get_addr() const;
-  std::string_view get_contents() const;
+  std::string_view get_contents() const { return contents; }
 
   ObjectFile *file;
   const ElfShdr &shdr;
   OutputSection *output_section = nullptr;
 
   std::string_view name;
-  u32 offset = -1;
+  const SectionNameInfo *name_info;
+  std::string_view contents;
+  u64 offset = -1;
 
 protected:
-  InputChunk(ObjectFile *file, const ElfShdr &shdr, std::string_view name);
+  InputChunk(ObjectFile *file, const ElfShdr &shdr, std::string_view name,
+             const SectionNameInfo *name_info);
 };
 
 enum RelType : u8 {
@@ -333,6 +588,13 @@ enum RelType : u8 {
   R_GOTTPOFF,
 };
 
+// Per-relocation metadata. All relocations of an object file share
+// a single array of these.
+struct RelInfo {
+  RelType type = R_NONE;
+  bool has_fragment = false;
+};
+
 struct EhReloc {
   Symbol &sym;
   u32 type;
@@ -360,7 +622,7 @@ struct FdeRecord {
   std::string_view contents;
   std::vector<EhReloc> rels;
   u32 cie_idx = -1;
-  u32 offset = -1;
+  u32 offset = -1; // relative to the end of its CIE
   std::atomic_bool is_alive = true;
 };
 
@@ -372,9 +634,9 @@ struct CieRecord {
   std::vector<FdeRecord> fdes;
 
   // For .eh_frame
-  u32 offset = -1;
-  u32 leader_offset = -1;
-  u32 fde_size = -1;
+  u64 offset = -1;
+  u64 leader_offset = -1;
+  u64 fde_size = -1;
 
   // For .eh_frame_hdr
   u32 num_fdes = 0;
@@ -387,22 +649,31 @@ struct CieRecord {
 class InputSection : public InputChunk {
 public:
   InputSection(ObjectFile *file, const ElfShdr &shdr, std::string_view name,
-               i64 section_idx)
-    : InputChunk(file, shdr, name), section_idx(section_idx) {}
+               i64 section_idx);
 
   void copy_buf() override;
+  void copy_contents();
+  void write_contents(u8 *base);
+  void write_to(u8 *base);
+  void apply_reloc();
+  void uncompress();
   void scan_relocations();
-  void report_undefined_symbols();
   void apply_reloc_alloc(u8 *base);
   void apply_reloc_nonalloc(u8 *base);
+  void scan_undefined_symbols();
+  const ElfRela *find_rel(u64 offset);
   void kill();
   inline i64 get_priority() const;
 
   std::span<ElfRela> rels;
-  std::vector<bool> has_fragments;
-  std::vector<SectionFragmentRef> rel_fragments;
-  std::vector<RelType> rel_types;
+  std::span<RelInfo> rel_info;
+  std::span<SectionFragmentRef> rel_fragments;
   std::span<FdeRecord> fdes;
+
+  // For SHF_COMPRESSED sections, `shdr` describes the uncompressed
+  // data, and `contents` is empty until uncompress() is called.
+  std::string_view compressed_contents;
+
   u64 reldyn_offset = 0;
   u32 section_idx = -1;
   bool is_comdat_member = false;
@@ -427,11 +698,17 @@ public:
 
   MergedSection &parent;
   std::vector<SectionFragment *> fragments;
+  // Fragment offsets, size and padding are 32-bit deltas relative to
+  // `offset`. An input section is never larger than 4 GiB.
   std::vector<u32> frag_offsets;
   u32 size = 0;
   u32 padding = 0;
 };
 
+void add_undefined_symbol(InputSection &isec, Symbol &sym, u64 offset);
+bool too_many_undefined_symbols();
+void report_undefined_symbols();
+
 //
 // output_chunks.cc
 //
@@ -443,10 +720,29 @@ public:
   virtual void copy_buf() {}
   virtual void update_shdr() {}
 
+  // With --early-copy, copy_contents() is called before the file layout
+  // is fixed to write bytes that don't depend on it, and copy_buf()
+  // writes the rest once contents_copied is set.
+  virtual void copy_contents() {}
+
+  // Debug sections are compressed before the file layout is fixed, so
+  // they can't be written to the output file. Instead, they are written
+  // piece by piece to temporary buffers. write_piece() writes the i'th
+  // piece to `buf`, which points to the piece's offset. Bytes that
+  // aren't covered by any piece are zero.
+  virtual i64 get_num_pieces() { return 0; }
+  virtual u64 get_piece_offset(i64 i) { return 0; }
+  virtual void write_piece(i64 i, u8 *buf) {}
+
   std::string_view name;
   i64 shndx = 0;
   Kind kind;
   bool starts_new_ptload = false;
+  bool contents_copied = false;
+
+  // True if the name is a valid C identifier, in which case we define
+  // __start_ and __stop_ symbols for this chunk.
+  bool is_c_identifier = false;
   ElfShdr shdr = { .sh_addralign = 1 };
 
 protected:
@@ -501,7 +797,8 @@ public:
 // Sections
 class OutputSection : public OutputChunk {
 public:
-  static OutputSection *get_instance(std::string_view name, u64 type, u64 flags);
+  static OutputSection *get_instance(const SectionNameInfo *info, u64 type,
+                                     u64 flags);
 
   OutputSection(std::string_view name, u32 type, u64 flags)
     : OutputChunk(REGULAR) {
@@ -513,11 +810,20 @@ public:
   }
 
   void copy_buf() override;
+  void copy_contents() override;
+  void copy_members(i64 begin, i64 end);
+
+  i64 get_num_pieces() override { return members.size(); }
+  u64 get_piece_offset(i64 i) override { return members[i]->offset; }
+  void write_piece(i64 i, u8 *buf) override;
 
   static inline std::vector<OutputSection *> instances;
 
   std::vector<InputSection *> members;
   u32 idx;
+
+private:
+  void clear_member_padding(i64 i);
 };
 
 class GotSection : public OutputChunk {
@@ -671,6 +977,20 @@ public:
   void copy_buf() override;
 };
 
+// If an output file has too many sections for the 16-bit st_shndx
+// field, section indices of symbols are stored to this section.
+class SymtabShndxSection : public OutputChunk {
+public:
+  SymtabShndxSection() : OutputChunk(SYNTHETIC) {
+    name = ".symtab_shndx";
+    shdr.sh_type = SHT_SYMTAB_SHNDX;
+    shdr.sh_entsize = 4;
+    shdr.sh_addralign = 4;
+  }
+
+  void update_shdr() override;
+};
+
 class DynsymSection : public OutputChunk {
 public:
   DynsymSection() : OutputChunk(SYNTHETIC) {
@@ -729,11 +1049,14 @@ public:
 
 class MergedSection : public OutputChunk {
 public:
-  static MergedSection *get_instance(std::string_view name, u64 type, u64 flags);
+  static MergedSection *get_instance(const SectionNameInfo *info, u64 type,
+                                     u64 flags);
 
   static inline std::vector<MergedSection *> instances;
 
   SectionFragment *insert(std::string_view data, u32 alignment) {
+    static LockStat stat("merged_section_insert");
+    LockTimer t(stat);
     typename decltype(map)::const_accessor acc;
     map.insert(acc, std::pair(SectionFragmentKey{data, alignment},
                               SectionFragment(data)));
@@ -741,6 +1064,14 @@ public:
   }
 
   void copy_buf() override;
+  void copy_contents() override;
+
+  i64 get_num_pieces() override { return members.size(); }
+  u64 get_piece_offset(i64 i) override { return members[i]->offset; }
+  void write_piece(i64 i, u8 *buf) override;
+
+  // Input sections in ascending order of their offsets
+  std::vector<MergeableSection *> members;
 
 private:
   MergedSection(std::string_view name, u64 flags, u32 type)
@@ -845,6 +1176,50 @@ public:
   static constexpr i64 HEADER_SIZE = 16;
 };
 
+class GnuDebuglinkSection : public OutputChunk {
+public:
+  GnuDebuglinkSection() : OutputChunk(SYNTHETIC) {
+    name = ".gnu_debuglink";
+    shdr.sh_type = SHT_PROGBITS;
+    shdr.sh_addralign = 4;
+  }
+
+  void update_shdr() override;
+  void copy_buf() override;
+  void write_crc(i64 filesize);
+
+  u32 crc = 0;
+};
+
+// A compressed copy of another output section. The original section's
+// contents are written to a temporary buffer and compressed in shards
+// in parallel when an instance is created.
+class CompressedSection : public OutputChunk {
+public:
+  CompressedSection(OutputChunk &chunk);
+  void compress_shard(i64 i);
+  void finalize();
+  void copy_buf() override;
+
+  i64 get_num_shards() const { return shards.size(); }
+
+private:
+  struct Shard {
+    u64 begin = 0;
+    u64 end = 0;
+    i64 piece_begin = 0;
+    i64 piece_end = 0;
+    std::vector<u8> data;
+    u32 adler = 0;
+  };
+
+  OutputChunk &chunk;
+  ElfChdr chdr = {};
+  std::vector<Shard> shards;
+  std::vector<u8> header;
+  std::vector<u8> trailer;
+};
+
 bool is_c_identifier(std::string_view name);
 std::vector<ElfPhdr> create_phdr();
 
@@ -882,6 +1257,17 @@ public:
   std::string name;
   i64 mtime = 0;
 
+  // False if the file is small and was read into memory.
+  bool is_mmapped = false;
+
+  // Files opened so far. Recorded only if --reproduce is given.
+  static inline std::vector<MemoryMappedFile *> opened_files;
+
+  // If --replay is given, files are read from this map instead of
+  // the file system. Keys are absolute paths.
+  static inline std::unordered_map<std::string, MemoryMappedFile *> replay_files;
+  static inline std::string replay_cwd;
+
 private:
   std::mutex mu;
   MemoryMappedFile *parent;
@@ -896,11 +1282,12 @@ public:
 
   MemoryMappedFile *mb;
   std::span<ElfShdr> elf_sections;
-  std::vector<Symbol *> symbols;
+  std::vector<Handle<Symbol>> symbols;
 
   std::string name;
   bool is_dso = false;
   u32 priority;
+  i32 numa_node = 0;
   std::atomic_bool is_alive = false;
 
   std::string_view get_string(const ElfShdr &shdr);
@@ -932,8 +1319,20 @@ public:
 
   static ObjectFile *create_internal_file();
 
+  // Symbols with a section index >= SHN_LORESERVE have SHN_XINDEX
+  // in st_shndx, and the real index is in SHT_SYMTAB_SHNDX section.
+  i64 get_shndx(const ElfSym &esym) {
+    if (esym.st_shndx == SHN_XINDEX) [[unlikely]]
+      return symtab_shndx_sec[&esym - &elf_syms[0]];
+    return esym.st_shndx;
+  }
+
+  InputSection *get_section(const ElfSym &esym) {
+    return sections[get_shndx(esym)];
+  }
+
   std::string archive_name;
-  std::vector<InputSection *> sections;
+  std::vector<Handle<InputSection>> sections;
   std::span<ElfSym> elf_syms;
   i64 first_global = 0;
   const bool is_in_lib = false;
@@ -950,6 +1349,7 @@ public:
   u64 strtab_size = 0;
 
   std::vector<MergeableSection *> mergeable_sections;
+  std::deque<ElfShdr> private_shdrs;
 
 private:
   void initialize_sections();
@@ -961,10 +1361,13 @@ private:
 
   std::vector<std::pair<ComdatGroup *, std::span<u32>>> comdat_groups;
   std::vector<SectionFragmentRef> sym_fragments;
+  std::vector<RelInfo> rel_info;
+  std::vector<SectionFragmentRef> rel_fragments;
   bool has_common_symbol;
 
   std::string_view symbol_strtab;
   const ElfShdr *symtab_sec;
+  std::span<u32> symtab_shndx_sec;
 };
 
 class SharedFile : public InputFile {
@@ -1023,7 +1426,9 @@ void parse_version_script(std::string path);
 
 class OutputFile {
 public:
-  static OutputFile *open(std::string path, u64 filesize);
+  static OutputFile *open(std::string path, u64 filesize,
+                          bool reuse_existing = true);
+  void resize(u64 filesize);
   virtual void close() = 0;
 
   u8 *buf;
@@ -1031,6 +1436,7 @@ public:
 
 protected:
   OutputFile(std::string path, u64 filesize) : path(path), filesize(filesize) {}
+  virtual void remap(u64 filesize) = 0;
 
   std::string path;
   u64 filesize;
@@ -1069,6 +1475,48 @@ private:
   static inline std::vector<Counter *> instances;
 };
 
+// FileCounter is a per-input-file counter for --time-trace-files.
+// Each thread accumulates values into its own map, so it is cheap to
+// update from parallel loops. Updates are no-op unless the option is
+// given.
+class FileCounter {
+public:
+  void add(InputFile *file, i64 delta) {
+    if (config.time_trace_files)
+      values.local()[file] += delta;
+  }
+
+  i64 get_value(InputFile *file);
+
+private:
+  tbb::enumerable_thread_specific<std::unordered_map<InputFile *, i64>> values;
+};
+
+class FileTimer {
+public:
+  FileTimer(FileCounter &counter, InputFile *file)
+    : counter(counter), file(file),
+      start(config.time_trace_files ? now_nsec() : 0) {}
+
+  ~FileTimer() {
+    if (config.time_trace_files)
+      counter.add(file, now_nsec() - start);
+  }
+
+private:
+  FileCounter &counter;
+  InputFile *file;
+  i64 start;
+};
+
+namespace file_stats {
+inline FileCounter parse_time;
+inline FileCounter copy_time;
+inline FileCounter discarded_bytes;
+}
+
+void print_file_stats();
+
 struct TimerRecord {
   TimerRecord(std::string name);
   void stop();
@@ -1087,24 +1535,85 @@ public:
   ~Timer();
   void stop();
   static void print();
+  static void restart_all();
+  static void write_records(int fd);
 
 private:
   static inline std::vector<TimerRecord *> records;
   TimerRecord *record;
 };
 
+std::function<void()> run_benchmark();
+
 //
 // gc_sections.cc
 //
 
 void gc_sections();
 
+//
+// gc_debug_info.cc
+//
+
+void gc_debug_info();
+
 //
 // icf_sections.cc
 //
 
 void icf_sections();
 
+//
+// gdb_index.cc
+//
+
+class GdbIndexSection : public OutputChunk {
+public:
+  GdbIndexSection() : OutputChunk(SYNTHETIC) {
+    name = ".gdb_index";
+    shdr.sh_type = SHT_PROGBITS;
+    shdr.sh_addralign = 4;
+  }
+
+  void construct();
+  void copy_buf() override;
+
+private:
+  struct Compunit {
+    u64 offset;
+    u64 size;
+  };
+
+  struct AddressRange {
+    Symbol *sym;
+    i64 addend;
+    u64 size;
+    u32 cu_idx;
+  };
+
+  struct NameEntry {
+    u32 hash = 0;
+    std::vector<u32> attrs;
+  };
+
+  typedef tbb::concurrent_hash_map<std::string_view, NameEntry> NameMap;
+
+  void read_compunits(ObjectFile &file, std::vector<Compunit> &vec);
+  void read_aranges(ObjectFile &file, std::vector<AddressRange> &vec);
+  void read_pubnames(ObjectFile &file, NameMap &map);
+  i64 find_compunit(i64 offset);
+
+  std::vector<Compunit> compunits;
+  std::vector<AddressRange> address_ranges;
+  std::vector<u32> hash_table;
+  std::vector<u8> pool;
+
+  u32 cu_list_offset = 0;
+  u32 address_area_offset = 0;
+  u32 symtab_offset = 0;
+  u32 constant_pool_offset = 0;
+};
+
 //
 // icf.cc
 //
@@ -1116,6 +1625,7 @@ void icf_sections();
 //
 
 void print_map();
+void print_layout(i64 filesize);
 
 //
 // subprocess.cc
@@ -1128,6 +1638,59 @@ bool resume_daemon(char **argv, i64 *code);
 void daemonize(char **argv, std::function<void()> *wait_for_client,
                std::function<void()> *on_complete);
 
+//
+// numa.cc
+//
+
+void numa_init();
+i64 numa_num_nodes();
+i64 numa_assign_node(u64 size);
+void numa_run(i64 node, std::function<void()> fn);
+void numa_wait();
+void numa_for_each_node(std::function<void(i64)> fn);
+void numa_parallel_for(i64 begin, i64 end, std::function<i64(i64)> get_node,
+                       std::function<void(i64)> fn);
+void numa_for_each_file(std::span<ObjectFile *> files,
+                        std::function<void(ObjectFile *)> fn);
+
+//
+// filepath.cc
+//
+
+std::string get_current_dir();
+std::string path_filename(std::string_view path);
+std::string path_clean(std::string_view path);
+std::string path_to_absolute(std::string_view path, std::string_view cwd);
+
+//
+// crc32.cc
+//
+
+u32 compute_crc32(u32 crc, u8 *buf, i64 len);
+std::vector<u8> crc32_solve(u32 current, u32 desired);
+
+//
+// tar.cc
+//
+
+class TarWriter {
+public:
+  static constexpr i64 BLOCK_SIZE = 512;
+
+  TarWriter(std::string path, std::string basedir);
+  ~TarWriter();
+  void append(std::string path, std::string_view data);
+
+private:
+  void write_block(const void *data, i64 size);
+
+  FILE *out = nullptr;
+  std::string basedir;
+};
+
+std::vector<std::pair<std::string, MemoryMappedFile *>>
+read_tar(MemoryMappedFile *mb);
+
 //
 // main.cc
 //
@@ -1163,6 +1726,7 @@ inline GnuHashSection *gnu_hash;
 inline ShstrtabSection *shstrtab;
 inline PltSection *plt;
 inline SymtabSection *symtab;
+inline SymtabShndxSection *symtab_shndx;
 inline DynsymSection *dynsym;
 inline EhFrameSection *eh_frame;
 inline EhFrameHdrSection *eh_frame_hdr;
@@ -1170,6 +1734,8 @@ inline CopyrelSection *copyrel;
 inline VersymSection *versym;
 inline VerneedSection *verneed;
 inline BuildIdSection *buildid;
+inline GnuDebuglinkSection *gnu_debuglink;
+inline GdbIndexSection *gdb_index;
 
 inline u64 tls_begin;
 inline u64 tls_end;
@@ -1353,3 +1919,17 @@ template <typename T, typename U>
 inline void sort(T &vec, U less) {
   std::stable_sort(vec.begin(), vec.end(), less);
 }
+
+// Returns the number of items each task of a parallel loop should
+// process. We create up to --tasks-per-thread tasks for each thread so
+// that idle threads can steal work. `ns_per_item` is a fixed estimate
+// of the cost of one item given by the caller, not a measured value.
+// It is only used to avoid tasks cheaper than 10 microseconds, for
+// which scheduling overhead would dominate.
+inline i64 get_grain_size(i64 num_items, i64 ns_per_item) {
+  constexpr i64 MIN_TASK_NS = 10000;
+  i64 min_grain = MIN_TASK_NS / std::max<i64>(ns_per_item, 1);
+  i64 num_tasks = std::max<i64>(config.thread_count * config.tasks_per_thread, 1);
+  i64 grain = (num_items + num_tasks - 1) / num_tasks;
+  return std::max<i64>({grain, min_grain, 1});
+}
@@ -0,0 +1,91 @@
+#include "mold.h"
+
+#include <tbb/info.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+
+// With --numa, input files are partitioned across NUMA nodes. Each
+// node has its own TBB arena whose threads are bound to that node,
+// and per-file work (parsing, relocation scanning and copying to the
+// output) runs in the arena of the node that owns the file. Because
+// memory is placed on first touch, data structures created for a file
+// and output pages written for it end up on the node that uses them.
+
+struct NumaNode {
+  NumaNode(tbb::numa_node_id id)
+    : arena(tbb::task_arena::constraints(id)) {}
+
+  tbb::task_arena arena;
+  tbb::task_group tg;
+};
+
+static std::vector<std::unique_ptr<NumaNode>> nodes;
+
+// Files are assigned to nodes in contiguous runs of this many bytes,
+// so that consecutive files, whose sections are laid out next to each
+// other in the output, are handled by the same node.
+static constexpr u64 NUMA_CHUNK_SIZE = 64 * 1024 * 1024;
+
+void numa_init() {
+  for (tbb::numa_node_id id : tbb::info::numa_nodes())
+    nodes.push_back(std::make_unique<NumaNode>(id));
+
+  static Counter counter("numa_nodes");
+  counter += nodes.size();
+}
+
+i64 numa_num_nodes() {
+  return nodes.size();
+}
+
+i64 numa_assign_node(u64 size) {
+  static u64 total = 0;
+  i64 node = (total / NUMA_CHUNK_SIZE) % nodes.size();
+  total += size;
+  return node;
+}
+
+void numa_run(i64 node, std::function<void()> fn) {
+  NumaNode &n = *nodes[node];
+  n.arena.execute([&]() { n.tg.run(fn); });
+}
+
+void numa_wait() {
+  for (std::unique_ptr<NumaNode> &n : nodes)
+    n->arena.execute([&]() { n->tg.wait(); });
+}
+
+void numa_for_each_node(std::function<void(i64)> fn) {
+  std::vector<tbb::task_group> tgs(nodes.size());
+
+  for (i64 i = 0; i < nodes.size(); i++)
+    nodes[i]->arena.execute([&, i]() { tgs[i].run([&, i]() { fn(i); }); });
+
+  for (i64 i = 0; i < nodes.size(); i++)
+    nodes[i]->arena.execute([&, i]() { tgs[i].wait(); });
+}
+
+// Runs fn(i) for each i in [begin, end) on the node returned by
+// get_node(i). Items are partitioned by node in a single pass first,
+// so each node iterates only over its own items.
+void numa_parallel_for(i64 begin, i64 end, std::function<i64(i64)> get_node,
+                       std::function<void(i64)> fn) {
+  std::vector<std::vector<i64>> slices(nodes.size());
+  for (i64 i = begin; i < end; i++)
+    slices[get_node(i)].push_back(i);
+
+  numa_for_each_node([&](i64 node) {
+    std::vector<i64> &slice = slices[node];
+    tbb::parallel_for((i64)0, (i64)slice.size(), [&](i64 i) {
+      fn(slice[i]);
+    });
+  });
+}
+
+void numa_for_each_file(std::span<ObjectFile *> files,
+                        std::function<void(ObjectFile *)> fn) {
+  numa_parallel_for(0, files.size(),
+                    [&](i64 i) { return files[i]->numa_node; },
+                    [&](i64 i) { fn(files[i]); });
+}
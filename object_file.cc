@@ -2,18 +2,31 @@
 
 #include <cstring>
 #include <fcntl.h>
-#include <regex>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 MemoryMappedFile *MemoryMappedFile::open(std::string path) {
+  if (!replay_files.empty()) {
+    auto it = replay_files.find(path_to_absolute(path, replay_cwd));
+    if (it == replay_files.end())
+      return nullptr;
+    return it->second->slice(path, 0, it->second->size());
+  }
+
   struct stat st;
   if (stat(path.c_str(), &st) == -1)
     return nullptr;
   u64 mtime = (u64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
-  return new MemoryMappedFile(path, nullptr, st.st_size, mtime);
+  MemoryMappedFile *mb = new MemoryMappedFile(path, nullptr, st.st_size, mtime);
+
+  if (!config.reproduce.empty()) {
+    static std::mutex mu;
+    std::lock_guard lock(mu);
+    opened_files.push_back(mb);
+  }
+  return mb;
 }
 
 MemoryMappedFile *MemoryMappedFile::must_open(std::string path) {
@@ -22,6 +35,34 @@ MemoryMappedFile *MemoryMappedFile::must_open(std::string path) {
   Fatal() << "cannot open " << path;
 }
 
+// Files smaller than this are read into a per-thread arena instead of
+// being mmap'ed. An mmap costs a VMA, page faults and contention on
+// the kernel's mmap lock, which add up if there are many tiny files.
+static constexpr i64 SMALL_FILE_SIZE = 64 * 1024;
+
+static u8 *read_small_file(std::string &name, i64 fd, i64 size) {
+  static constexpr i64 ARENA_SIZE = 4 * 1024 * 1024;
+  thread_local u8 *cur = nullptr;
+  thread_local u8 *end = nullptr;
+
+  i64 alloc_size = align_to(size, 16);
+  if (end - cur < alloc_size) {
+    cur = (u8 *)malloc(ARENA_SIZE);
+    end = cur + ARENA_SIZE;
+  }
+
+  u8 *buf = cur;
+  cur += alloc_size;
+
+  for (i64 off = 0; off < size;) {
+    i64 n = pread(fd, buf + off, size - off, off);
+    if (n <= 0)
+      Fatal() << name << ": read failed: " << strerror(errno);
+    off += n;
+  }
+  return buf;
+}
+
 u8 *MemoryMappedFile::data() {
   if (data_)
     return data_;
@@ -34,9 +75,27 @@ u8 *MemoryMappedFile::data() {
   if (fd == -1)
     Fatal() << name << ": cannot open: " << strerror(errno);
 
-  data_ = (u8 *)mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (data_ == MAP_FAILED)
-    Fatal() << name << ": mmap failed: " << strerror(errno);
+  // Counters to compare the two strategies. Time spent on page faults
+  // of mmap'ed files is not included.
+  static Counter read_files("read_files");
+  static Counter read_usec("read_files_usec");
+  static Counter mmapped_files("mmapped_files");
+  static Counter mmap_usec("mmapped_files_usec");
+  i64 start = now_nsec();
+
+  if (size_ < SMALL_FILE_SIZE) {
+    data_ = read_small_file(name, fd, size_);
+    read_files++;
+    read_usec += (now_nsec() - start) / 1000;
+  } else {
+    data_ = (u8 *)mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data_ == MAP_FAILED)
+      Fatal() << name << ": mmap failed: " << strerror(errno);
+    is_mmapped = true;
+    mmapped_files++;
+    mmap_usec += (now_nsec() - start) / 1000;
+  }
+
   close(fd);
   return data_;
 }
@@ -44,6 +103,7 @@ u8 *MemoryMappedFile::data() {
 MemoryMappedFile *MemoryMappedFile::slice(std::string name, u64 start, u64 size) {
   MemoryMappedFile *mb = new MemoryMappedFile(name, data_ + start, size);
   mb->parent = this;
+  mb->is_mmapped = is_mmapped;
   return mb;
 }
 
@@ -57,12 +117,29 @@ InputFile::InputFile(MemoryMappedFile *mb) : mb(mb), name(mb->name) {
   is_dso = (ehdr.e_type == ET_DYN);
 
   u8 *sh_begin = mb->data() + ehdr.e_shoff;
-  u8 *sh_end = sh_begin + ehdr.e_shnum * sizeof(ElfShdr);
+  if (ehdr.e_shoff && mb->data() + mb->size() < sh_begin + sizeof(ElfShdr))
+    Fatal() << *this << ": e_shoff corrupted: " << ehdr.e_shoff;
+
+  // e_shnum contains the total number of sections in an object file.
+  // Since it is a 16-bit integer field, it's not large enough to
+  // represent >65535 sections. If it overflows, the real value is
+  // stored to the first section's sh_size.
+  i64 num_sections = ehdr.e_shnum;
+  if (num_sections == 0 && ehdr.e_shoff)
+    num_sections = ((ElfShdr *)sh_begin)->sh_size;
+
+  u8 *sh_end = sh_begin + num_sections * sizeof(ElfShdr);
   if (mb->data() + mb->size() < sh_end)
     Fatal() << *this << ": e_shoff or e_shnum corrupted: "
-            << mb->size() << " " << ehdr.e_shnum;
+            << mb->size() << " " << num_sections;
   elf_sections = {(ElfShdr *)sh_begin, (ElfShdr *)sh_end};
-  shstrtab = get_string(ehdr.e_shstrndx);
+
+  // Likewise, if e_shstrndx is SHN_XINDEX, the real index is
+  // in the first section's sh_link.
+  i64 shstrtab_idx = ehdr.e_shstrndx;
+  if (shstrtab_idx == SHN_XINDEX)
+    shstrtab_idx = elf_sections[0].sh_link;
+  shstrtab = get_string(shstrtab_idx);
 }
 
 std::string_view InputFile::get_string(const ElfShdr &shdr) {
@@ -115,6 +192,15 @@ void ObjectFile::initialize_sections() {
     if ((shdr.sh_flags & SHF_EXCLUDE) && !(shdr.sh_flags & SHF_ALLOC))
       continue;
 
+    std::string_view name = shstrtab.data() + shdr.sh_name;
+
+    // If --strip-debug is given, we don't create InputSections for
+    // debug sections, so neither they nor their relocation sections
+    // are ever read.
+    if (config.strip_debug && !(shdr.sh_flags & SHF_ALLOC) &&
+        name.starts_with(".debug"))
+      continue;
+
     switch (shdr.sh_type) {
     case SHT_GROUP: {
       // Get the signature of this section group.
@@ -142,8 +228,6 @@ void ObjectFile::initialize_sections() {
       break;
     }
     case SHT_SYMTAB_SHNDX:
-      Fatal() << *this << ": SHT_SYMTAB_SHNDX section is not supported";
-      break;
     case SHT_SYMTAB:
     case SHT_STRTAB:
     case SHT_REL:
@@ -154,14 +238,15 @@ void ObjectFile::initialize_sections() {
       static Counter counter("regular_sections");
       counter++;
 
-      std::string_view name = shstrtab.data() + shdr.sh_name;
-      this->sections[i] = new InputSection(this, shdr, name, i);
+      this->sections[i] = Arena<InputSection>::create(this, shdr, name, i);
       break;
     }
     }
   }
 
   // Attach relocation sections to their target sections.
+  i64 num_rels = 0;
+
   for (const ElfShdr &shdr : elf_sections) {
     if (shdr.sh_type != SHT_RELA)
       continue;
@@ -172,9 +257,18 @@ void ObjectFile::initialize_sections() {
 
     if (InputSection *target = sections[shdr.sh_info]) {
       target->rels = get_data<ElfRela>(shdr);
-      target->has_fragments.resize(target->rels.size());
-      if (target->shdr.sh_flags & SHF_ALLOC)
-        target->rel_types.resize(target->rels.size());
+      num_rels += target->rels.size();
+    }
+  }
+
+  // Allocate relocation metadata for all sections at once.
+  rel_info.resize(num_rels);
+  i64 idx = 0;
+
+  for (InputSection *isec : sections) {
+    if (isec && !isec->rels.empty()) {
+      isec->rel_info = std::span(rel_info).subspan(idx, isec->rels.size());
+      idx += isec->rels.size();
     }
   }
 
@@ -347,11 +441,12 @@ void ObjectFile::initialize_symbols() {
   counter += elf_syms.size();
 
   // Initialize local symbols
-  Symbol *locals = new Symbol[first_global];
+  u32 locals = Arena<Symbol>::alloc(first_global);
+  new (&Arena<Symbol>::get(locals)) Symbol;
 
   for (i64 i = 1; i < first_global; i++) {
     const ElfSym &esym = elf_syms[i];
-    Symbol &sym = locals[i];
+    Symbol &sym = *new (&Arena<Symbol>::get(locals + i)) Symbol;
 
     sym.name = symbol_strtab.data() + esym.st_name;
     sym.file = this;
@@ -362,7 +457,7 @@ void ObjectFile::initialize_symbols() {
     if (!esym.is_abs()) {
       if (esym.is_common())
         Fatal() << *this << ": common local symbol?";
-      sym.input_section = sections[esym.st_shndx];
+      sym.input_section = get_section(esym);
     }
 
     if (should_write_symtab(sym)) {
@@ -376,7 +471,7 @@ void ObjectFile::initialize_symbols() {
   sym_fragments.resize(elf_syms.size() - first_global);
 
   for (i64 i = 0; i < first_global; i++)
-    symbols[i] = &locals[i];
+    symbols[i] = Handle<Symbol>(locals + i);
 
   // Initialize global symbols
   for (i64 i = first_global; i < elf_syms.size(); i++) {
@@ -405,18 +500,23 @@ void ObjectFile::initialize_mergeable_sections() {
     }
   }
 
-  // Initialize rel_fragments
+  // Initialize rel_fragments. Fragment references of all sections
+  // are stored to one vector, and each section gets a slice of it.
+  std::vector<std::pair<InputSection *, i64>> starts;
+
   for (InputSection *isec : sections) {
     if (!isec || isec->rels.empty())
       continue;
 
+    starts.push_back({isec, rel_fragments.size()});
+
     for (i64 i = 0; i < isec->rels.size(); i++) {
       const ElfRela &rel = isec->rels[i];
       const ElfSym &esym = elf_syms[rel.r_sym];
       if (esym.st_type != STT_SECTION)
         continue;
 
-      MergeableSection *m = mergeable_sections[esym.st_shndx];
+      MergeableSection *m = mergeable_sections[get_shndx(esym)];
       if (!m)
         continue;
 
@@ -429,18 +529,26 @@ void ObjectFile::initialize_mergeable_sections() {
       i64 idx = it - 1 - offsets.begin();
 
       SectionFragmentRef ref{m->fragments[idx], (i32)(offset - offsets[idx])};
-      isec->rel_fragments.push_back(ref);
-      isec->has_fragments[i] = true;
+      rel_fragments.push_back(ref);
+      isec->rel_info[i].has_fragment = true;
     }
   }
 
+  for (i64 i = 0; i < starts.size(); i++) {
+    auto [isec, begin] = starts[i];
+    i64 end = rel_fragments.size();
+    if (i + 1 < starts.size())
+      end = starts[i + 1].second;
+    isec->rel_fragments = std::span(rel_fragments).subspan(begin, end - begin);
+  }
+
   // Initialize sym_fragments
   for (i64 i = 0; i < elf_syms.size(); i++) {
     const ElfSym &esym = elf_syms[i];
     if (esym.is_abs() || esym.is_common())
       continue;
 
-    MergeableSection *m = mergeable_sections[esym.st_shndx];
+    MergeableSection *m = mergeable_sections[get_shndx(esym)];
     if (!m)
       continue;
 
@@ -464,6 +572,7 @@ void ObjectFile::initialize_mergeable_sections() {
 }
 
 void ObjectFile::parse() {
+  FileTimer t(file_stats::parse_time, this);
   sections.resize(elf_sections.size());
   symtab_sec = find_section(SHT_SYMTAB);
 
@@ -471,6 +580,12 @@ void ObjectFile::parse() {
     first_global = symtab_sec->sh_info;
     elf_syms = get_data<ElfSym>(*symtab_sec);
     symbol_strtab = get_string(symtab_sec->sh_link);
+
+    if (ElfShdr *shdr = find_section(SHT_SYMTAB_SHNDX)) {
+      symtab_shndx_sec = get_data<u32>(*shdr);
+      if (symtab_shndx_sec.size() != elf_syms.size())
+        Fatal() << *this << ": corrupted SHT_SYMTAB_SHNDX section";
+    }
   }
 
   initialize_sections();
@@ -512,9 +627,10 @@ void ObjectFile::maybe_override_symbol(Symbol &sym, i64 symidx) {
   InputSection *isec = nullptr;
   const ElfSym &esym = elf_syms[symidx];
   if (!esym.is_abs() && !esym.is_common())
-    isec = sections[esym.st_shndx];
+    isec = get_section(esym);
 
-  std::lock_guard lock(sym.mu);
+  static LockStat stat("symbol_mu:override");
+  LockGuard lock(sym.mu, stat);
 
   u64 new_rank = get_rank(this, esym, isec);
   u64 existing_rank = get_rank(sym);
@@ -551,7 +667,8 @@ void ObjectFile::resolve_symbols() {
     Symbol &sym = *symbols[i];
 
     if (is_in_lib) {
-      std::lock_guard lock(sym.mu);
+      static LockStat stat("symbol_mu:lazy");
+      LockGuard lock(sym.mu, stat);
       bool is_new = !sym.file;
       bool tie_but_higher_priority =
         sym.is_placeholder && this->priority < sym.file->priority;
@@ -603,7 +720,8 @@ void ObjectFile::handle_undefined_weak_symbols() {
 
     if (esym.is_undef() && esym.st_bind == STB_WEAK) {
       Symbol &sym = *symbols[i];
-      std::lock_guard lock(sym.mu);
+      static LockStat stat("symbol_mu:undef_weak");
+      LockGuard lock(sym.mu, stat);
 
       bool is_new = !sym.file || sym.is_placeholder;
       bool tie_but_higher_priority =
@@ -629,10 +747,15 @@ void ObjectFile::handle_undefined_weak_symbols() {
 void ObjectFile::resolve_comdat_groups() {
   for (auto &pair : comdat_groups) {
     ComdatGroup *group = pair.first;
+    static LockStat stat("comdat_owner_cas");
+    LockTimer t(stat);
+
     ObjectFile *cur = group->owner;
-    while (!cur || cur->priority > this->priority)
+    while (!cur || cur->priority > this->priority) {
       if (group->owner.compare_exchange_weak(cur, this))
         break;
+      t.retry();
+    }
   }
 }
 
@@ -677,7 +800,8 @@ void ObjectFile::convert_common_symbols() {
     return;
 
   static OutputSection *bss =
-    OutputSection::get_instance(".bss", SHT_NOBITS, SHF_WRITE | SHF_ALLOC);
+    OutputSection::get_instance(SectionNameInfo::get(".bss"), SHT_NOBITS,
+                                SHF_WRITE | SHF_ALLOC);
 
   for (i64 i = first_global; i < elf_syms.size(); i++) {
     if (!elf_syms[i].is_common())
@@ -694,7 +818,8 @@ void ObjectFile::convert_common_symbols() {
     shdr->sh_size = elf_syms[i].st_size;
     shdr->sh_addralign = 1;
 
-    auto *isec = new InputSection(this, *shdr, ".bss", sections.size());
+    Handle<InputSection> isec =
+      Arena<InputSection>::create(this, *shdr, ".bss", sections.size());
     isec->output_section = bss;
     sections.push_back(isec);
 
@@ -740,9 +865,14 @@ void ObjectFile::write_symtab() {
   i64 symtab_off;
   i64 strtab_off = strtab_offset;
 
+  u32 *shndx_base = nullptr;
+  if (out::symtab_shndx)
+    shndx_base = (u32 *)(out::buf + out::symtab_shndx->shdr.sh_offset);
+
   auto write_sym = [&](i64 i) {
     Symbol &sym = *symbols[i];
     ElfSym &esym = *(ElfSym *)(symtab_base + symtab_off);
+    i64 symidx = symtab_off / sizeof(ElfSym);
     symtab_off += sizeof(ElfSym);
 
     esym = elf_syms[i];
@@ -753,12 +883,20 @@ void ObjectFile::write_symtab() {
     else
       esym.st_value = sym.get_addr();
 
-    if (sym.input_section)
-      esym.st_shndx = sym.input_section->output_section->shndx;
-    else if (sym.shndx)
-      esym.st_shndx = sym.shndx;
-    else
+    auto set_shndx = [&](i64 shndx) {
+      if (shndx_base)
+        shndx_base[symidx] = shndx;
+      esym.st_shndx = (shndx < SHN_LORESERVE) ? shndx : SHN_XINDEX;
+    };
+
+    if (sym.input_section) {
+      set_shndx(sym.input_section->output_section->shndx);
+    } else if (sym.shndx) {
+      set_shndx(sym.shndx);
+    } else {
+      set_shndx(0);
       esym.st_shndx = SHN_ABS;
+    }
 
     write_string(strtab_base + strtab_off, sym.name);
     strtab_off += sym.name.size() + 1;
@@ -776,14 +914,23 @@ void ObjectFile::write_symtab() {
 }
 
 bool is_c_identifier(std::string_view name) {
-  static std::regex re("[a-zA-Z_][a-zA-Z0-9_]*");
-  return std::regex_match(name.begin(), name.end(), re);
+  auto is_alpha = [](char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_';
+  };
+
+  if (name.empty() || !is_alpha(name[0]))
+    return false;
+
+  for (char c : name)
+    if (!is_alpha(c) && !('0' <= c && c <= '9'))
+      return false;
+  return true;
 }
 
 ObjectFile::ObjectFile() {
   // Create linker-synthesized symbols.
   auto *esyms = new std::vector<ElfSym>(1);
-  symbols.push_back(new Symbol);
+  symbols.push_back(Arena<Symbol>::create());
   first_global = 1;
   is_alive = true;
   priority = 1;
@@ -796,9 +943,9 @@ ObjectFile::ObjectFile() {
     esym.st_visibility = visibility;
     esyms->push_back(esym);
 
-    Symbol *sym = Symbol::intern(name);
+    Handle<Symbol> sym = Symbol::intern(name);
     symbols.push_back(sym);
-    return sym;
+    return (Symbol *)sym;
   };
 
   out::__ehdr_start = add("__ehdr_start", STV_HIDDEN);
@@ -821,7 +968,7 @@ ObjectFile::ObjectFile() {
     out::__GNU_EH_FRAME_HDR = add("__GNU_EH_FRAME_HDR", STV_HIDDEN);
 
   for (OutputChunk *chunk : out::chunks) {
-    if (!is_c_identifier(chunk->name))
+    if (!chunk->is_c_identifier)
       continue;
 
     auto *start = new std::string("__start_" + std::string(chunk->name));
@@ -857,6 +1004,7 @@ std::string_view SharedFile::get_soname() {
 }
 
 void SharedFile::parse() {
+  FileTimer t(file_stats::parse_time, this);
   symtab_sec = find_section(SHT_DYNSYM);
   if (!symtab_sec)
     return;
@@ -922,7 +1070,8 @@ void SharedFile::resolve_symbols() {
     Symbol &sym = *symbols[i];
     const ElfSym &esym = *elf_syms[i];
 
-    std::lock_guard lock(sym.mu);
+    static LockStat stat("symbol_mu:dso");
+    LockGuard lock(sym.mu, stat);
 
     u64 new_rank = get_rank(this, esym, nullptr);
     u64 existing_rank = get_rank(sym);
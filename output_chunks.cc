@@ -3,8 +3,11 @@
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 #include <shared_mutex>
+#include <tbb/blocked_range.h>
 #include <tbb/parallel_for_each.h>
 #include <tbb/parallel_sort.h>
+#include <zlib.h>
+#include <zstd.h>
 
 void OutputEhdr::copy_buf() {
   ElfEhdr &hdr = *(ElfEhdr *)(out::buf + shdr.sh_offset);
@@ -24,8 +27,13 @@ void OutputEhdr::copy_buf() {
   hdr.e_phentsize = sizeof(ElfPhdr);
   hdr.e_phnum = out::phdr->shdr.sh_size / sizeof(ElfPhdr);
   hdr.e_shentsize = sizeof(ElfShdr);
-  hdr.e_shnum = out::shdr->shdr.sh_size / sizeof(ElfShdr);
-  hdr.e_shstrndx = out::shstrtab->shndx;
+
+  // If the values don't fit in the 16-bit fields, they are stored
+  // to the first section header. See OutputShdr::copy_buf().
+  i64 shnum = out::shdr->shdr.sh_size / sizeof(ElfShdr);
+  hdr.e_shnum = (shnum < SHN_LORESERVE) ? shnum : 0;
+  hdr.e_shstrndx = (out::shstrtab->shndx < SHN_LORESERVE)
+    ? out::shstrtab->shndx : SHN_XINDEX;
 }
 
 void OutputShdr::update_shdr() {
@@ -40,6 +48,12 @@ void OutputShdr::copy_buf() {
   ElfShdr *hdr = (ElfShdr *)(out::buf + shdr.sh_offset);
   hdr[0] = {};
 
+  i64 shnum = shdr.sh_size / sizeof(ElfShdr);
+  if (shnum >= SHN_LORESERVE)
+    hdr[0].sh_size = shnum;
+  if (out::shstrtab->shndx >= SHN_LORESERVE)
+    hdr[0].sh_link = out::shstrtab->shndx;
+
   i64 i = 1;
   for (OutputChunk *chunk : out::chunks)
     if (chunk->kind != OutputChunk::HEADER)
@@ -161,11 +175,23 @@ std::vector<ElfPhdr> create_phdr() {
 }
 
 void OutputPhdr::update_shdr() {
-  shdr.sh_size = create_phdr().size() * sizeof(ElfPhdr);
+  for (OutputChunk *chunk : out::chunks)
+    chunk->starts_new_ptload = false;
+
+  // With --early-copy, the size was fixed by the provisional layout,
+  // which may have more segments than the final one because empty
+  // synthetic sections are removed later. Unused entries are PT_NULL.
+  i64 size = create_phdr().size() * sizeof(ElfPhdr);
+  if (config.early_copy)
+    shdr.sh_size = std::max<i64>(shdr.sh_size, size);
+  else
+    shdr.sh_size = size;
 }
 
 void OutputPhdr::copy_buf() {
-  write_vector(out::buf + shdr.sh_offset, create_phdr());
+  std::vector<ElfPhdr> vec = create_phdr();
+  vec.resize(shdr.sh_size / sizeof(ElfPhdr));
+  write_vector(out::buf + shdr.sh_offset, vec);
 }
 
 void InterpSection::copy_buf() {
@@ -295,9 +321,17 @@ void SymtabSection::copy_buf() {
   memset(out::buf + shdr.sh_offset, 0, sizeof(ElfSym));
   out::buf[out::strtab->shdr.sh_offset] = '\0';
 
+  if (out::symtab_shndx)
+    *(u32 *)(out::buf + out::symtab_shndx->shdr.sh_offset) = 0;
+
   tbb::parallel_for_each(out::objs, [](ObjectFile *file) { file->write_symtab(); });
 }
 
+void SymtabShndxSection::update_shdr() {
+  shdr.sh_size = out::symtab->shdr.sh_size / sizeof(ElfSym) * 4;
+  shdr.sh_link = out::symtab->shndx;
+}
+
 static std::vector<u64> create_dynamic_section() {
   std::vector<u64> vec;
 
@@ -376,68 +410,126 @@ void DynamicSection::copy_buf() {
   write_vector(out::buf + shdr.sh_offset, create_dynamic_section());
 }
 
-static std::string_view get_output_name(std::string_view name) {
-  static std::string_view common_names[] = {
-    ".text.", ".data.rel.ro.", ".data.", ".rodata.", ".bss.rel.ro.",
-    ".bss.", ".init_array.", ".fini_array.", ".tbss.", ".tdata.",
-  };
-
-  for (std::string_view s1 : common_names) {
-    std::string_view s2 = s1.substr(0, s1.size() - 1);
-    if (name.starts_with(s1) || name == s2)
-      return s2;
-  }
-  return name;
-}
-
 OutputSection *
-OutputSection::get_instance(std::string_view name, u64 type, u64 flags) {
+OutputSection::get_instance(const SectionNameInfo *info, u64 type,
+                            u64 flags) {
+  std::string_view name = info->output_name;
   if (name == ".eh_frame" && type == SHT_X86_64_UNWIND)
     type = SHT_PROGBITS;
 
-  name = get_output_name(name);
   flags = flags & ~(u64)SHF_GROUP;
 
+  auto matches = [&](OutputSection *osec) {
+    return osec && name == osec->name && type == osec->shdr.sh_type &&
+           flags == (osec->shdr.sh_flags & ~SHF_GROUP);
+  };
+
+  // Input sections of the same name are almost always mapped to the
+  // same output section, so we first try the one cached for the name.
+  // This avoids taking the lock below for every input section.
+  OutputSection *osec = info->output_section.load(std::memory_order_acquire);
+  if (matches(osec))
+    return osec;
+
   auto find = [&]() -> OutputSection * {
     for (OutputSection *osec : OutputSection::instances)
-      if (name == osec->name && type == osec->shdr.sh_type &&
-          flags == (osec->shdr.sh_flags & ~SHF_GROUP))
+      if (matches(osec))
         return osec;
     return nullptr;
   };
 
   // Search for an exiting output section.
   static std::shared_mutex mu;
-  {
-    std::shared_lock lock(mu);
+  static LockStat read_stat("output_section_instance:read");
+  static LockStat write_stat("output_section_instance:write");
+
+  osec = [&] {
+    {
+      SharedLockGuard lock(mu, read_stat);
+      if (OutputSection *osec = find())
+        return osec;
+    }
+
+    // Create a new output section.
+    LockGuard lock(mu, write_stat);
     if (OutputSection *osec = find())
       return osec;
-  }
-
-  // Create a new output section.
-  std::unique_lock lock(mu);
-  if (OutputSection *osec = find())
+    OutputSection *osec = new OutputSection(name, type, flags);
+    osec->is_c_identifier = info->is_c_identifier;
     return osec;
-  return new OutputSection(name, type, flags);
+  }();
+
+  info->output_section.store(osec, std::memory_order_release);
+  return osec;
 }
 
 void OutputSection::copy_buf() {
+  copy_members(0, members.size());
+}
+
+// With --numa, each node writes the output ranges contributed by
+// its own files.
+template <typename Fn>
+static void for_each_member(std::span<InputSection *> members,
+                            i64 begin, i64 end, Fn fn) {
+  if (config.numa) {
+    numa_parallel_for(begin, end,
+                      [&](i64 i) { return members[i]->file->numa_node; },
+                      fn);
+    return;
+  }
+
+  tbb::parallel_for(begin, end, fn);
+}
+
+// Zero-clears padding after members[i].
+void OutputSection::clear_member_padding(i64 i) {
+  u64 this_end = members[i]->offset + members[i]->shdr.sh_size;
+  u64 next_start = (i == members.size() - 1) ?
+    shdr.sh_size : members[i + 1]->offset;
+  memset(out::buf + shdr.sh_offset + this_end, 0, next_start - this_end);
+}
+
+// Copies members[begin, end) to the output file. If their contents
+// have already been copied by copy_contents(), we apply relocations.
+void OutputSection::copy_members(i64 begin, i64 end) {
   if (shdr.sh_type == SHT_NOBITS)
     return;
 
-  tbb::parallel_for((i64)0, (i64)members.size(), [&](u64 i) {
+  for_each_member(members, begin, end, [&](i64 i) {
     InputSection &isec = *members[i];
     if (isec.shdr.sh_type == SHT_NOBITS)
       return;
 
+    FileTimer t(file_stats::copy_time, isec.file);
+    if (contents_copied) {
+      isec.apply_reloc();
+      return;
+    }
+
     // Copy section contents to an output file
     isec.copy_buf();
+    clear_member_padding(i);
+  });
+}
+
+void OutputSection::write_piece(i64 i, u8 *buf) {
+  FileTimer t(file_stats::copy_time, members[i]->file);
+  members[i]->write_to(buf);
+}
+
+void OutputSection::copy_contents() {
+  if (shdr.sh_type == SHT_NOBITS)
+    return;
+
+  for_each_member(members, 0, members.size(), [&](i64 i) {
+    InputSection &isec = *members[i];
+    if (isec.shdr.sh_type == SHT_NOBITS)
+      return;
 
-    // Zero-clear trailing padding
-    u64 this_end = isec.offset + isec.shdr.sh_size;
-    u64 next_start = (i == members.size() - 1) ?
-      shdr.sh_size : members[i + 1]->offset;
-    memset(out::buf + shdr.sh_offset + this_end, 0, next_start - this_end);
+    FileTimer t(file_stats::copy_time, isec.file);
+    isec.copy_contents();
+    clear_member_padding(i);
   });
 }
 
@@ -640,8 +732,15 @@ void DynsymSection::copy_buf() {
     esym.st_bind = sym.esym->st_bind;
     esym.st_size = sym.esym->st_size;
 
+    // .dynsym doesn't have an extended section index table. The
+    // dynamic loader only distinguishes SHN_UNDEF and SHN_ABS from
+    // other indices, so SHN_XINDEX works as a placeholder.
+    auto get_shndx = [](OutputChunk *chunk) -> u16 {
+      return (chunk->shndx < SHN_LORESERVE) ? chunk->shndx : SHN_XINDEX;
+    };
+
     if (sym.has_copyrel) {
-      esym.st_shndx = out::copyrel->shndx;
+      esym.st_shndx = get_shndx(out::copyrel);
       esym.st_value = sym.get_addr();
     } else if (sym.is_imported || sym.esym->is_undef()) {
       esym.st_shndx = SHN_UNDEF;
@@ -649,10 +748,10 @@ void DynsymSection::copy_buf() {
       esym.st_shndx = SHN_ABS;
       esym.st_value = sym.get_addr();
     } else if (sym.st_type == STT_TLS) {
-      esym.st_shndx = sym.input_section->output_section->shndx;
+      esym.st_shndx = get_shndx(sym.input_section->output_section);
       esym.st_value = sym.get_addr() - out::tls_begin;
     } else {
-      esym.st_shndx = sym.input_section->output_section->shndx;
+      esym.st_shndx = get_shndx(sym.input_section->output_section);
       esym.st_value = sym.get_addr();
     }
   }
@@ -747,70 +846,98 @@ void GnuHashSection::copy_buf() {
 }
 
 MergedSection *
-MergedSection::get_instance(std::string_view name, u64 type, u64 flags) {
-  name = get_output_name(name);
+MergedSection::get_instance(const SectionNameInfo *info, u64 type,
+                            u64 flags) {
+  std::string_view name = info->output_name;
   flags = flags & ~(u64)SHF_MERGE & ~(u64)SHF_STRINGS;
 
+  auto matches = [&](MergedSection *osec) {
+    return osec && std::tuple(name, flags, type) ==
+           std::tuple(osec->name, osec->shdr.sh_flags, osec->shdr.sh_type);
+  };
+
+  // Try the output section cached for the name first.
+  MergedSection *osec = info->merged_section.load(std::memory_order_acquire);
+  if (matches(osec))
+    return osec;
+
   auto find = [&]() -> MergedSection * {
     for (MergedSection *osec : MergedSection::instances)
-      if (std::tuple(name, flags, type) ==
-          std::tuple(osec->name, osec->shdr.sh_flags, osec->shdr.sh_type))
+      if (matches(osec))
         return osec;
     return nullptr;
   };
 
   // Search for an exiting output section.
   static std::shared_mutex mu;
-  {
-    std::shared_lock lock(mu);
+  static LockStat read_stat("merged_section_instance:read");
+  static LockStat write_stat("merged_section_instance:write");
+
+  osec = [&] {
+    {
+      SharedLockGuard lock(mu, read_stat);
+      if (MergedSection *osec = find())
+        return osec;
+    }
+
+    // Create a new output section.
+    LockGuard lock(mu, write_stat);
     if (MergedSection *osec = find())
       return osec;
-  }
 
-  // Create a new output section.
-  std::unique_lock lock(mu);
-  if (MergedSection *osec = find())
+    auto *osec = new MergedSection(name, flags, type);
+    osec->is_c_identifier = info->is_c_identifier;
+    MergedSection::instances.push_back(osec);
     return osec;
+  }();
 
-  auto *osec = new MergedSection(name, flags, type);
-  MergedSection::instances.push_back(osec);
+  info->merged_section.store(osec, std::memory_order_release);
   return osec;
 }
 
 void MergedSection::copy_buf() {
-  u8 *base = out::buf + shdr.sh_offset;
+  if (!contents_copied)
+    copy_contents();
+}
 
-  tbb::parallel_for_each(out::objs, [&](ObjectFile *file) {
-    for (MergeableSection *isec : file->mergeable_sections) {
-      if (&isec->parent != this)
-        continue;
+// Writes fragments owned by a given input section to `buf`.
+static void write_fragments(MergeableSection &isec, u8 *buf) {
+  i64 offset = 0;
+  for (SectionFragment *frag : isec.fragments) {
+    if (frag->isec != &isec || !frag->is_alive || frag->offset < offset)
+      continue;
 
-      // Clear padding between input sections
-      if (isec->padding)
-        memset(base + isec->offset - isec->padding, 0, isec->padding);
+    // Clear padding between section fragments
+    if (offset < frag->offset) {
+      memset(buf + offset, 0, frag->offset - offset);
+      offset = frag->offset;
+    }
 
-      i64 offset = 0;
-      for (SectionFragment *frag : isec->fragments) {
-        if (frag->isec != isec || !frag->is_alive || frag->offset < offset)
-          continue;
+    memcpy(buf + frag->offset, frag->data.data(), frag->data.size());
+    offset += frag->data.size();
+  }
+}
 
-        // Clear padding between section fragments
-        if (offset < frag->offset) {
-          memset(base + isec->offset + offset, 0, frag->offset - offset);
-          offset = frag->offset;
-        }
+// Merged sections don't have relocations, so their contents are
+// final as soon as the section offset is fixed.
+void MergedSection::copy_contents() {
+  u8 *base = out::buf + shdr.sh_offset;
 
-        memcpy(base + isec->offset + frag->offset,
-               frag->data.data(), frag->data.size());
-        offset += frag->data.size();
-      }
-    }
+  tbb::parallel_for_each(members, [&](MergeableSection *isec) {
+    // Clear padding between input sections
+    if (isec->padding)
+      memset(base + isec->offset - isec->padding, 0, isec->padding);
+    write_fragments(*isec, base + isec->offset);
   });
 
   static Counter merged_strings("merged_strings");
   merged_strings += map.size();
 }
 
+void MergedSection::write_piece(i64 i, u8 *buf) {
+  write_fragments(*members[i], buf);
+}
+
 void EhFrameSection::construct() {
   // Remove dead FDEs and assign them offsets within their corresponding
   // CIE group.
@@ -823,10 +950,13 @@ void EhFrameSection::construct() {
       for (FdeRecord &fde : cie.fdes) {
         if (!fde.is_alive)
           continue;
+
+        // FDE offsets are stored as 32-bit deltas from their CIE.
+        if (offset > UINT32_MAX)
+          Fatal() << *file << ": .eh_frame too large";
         fde.offset = offset;
         offset += fde.contents.size();
         cie.num_fdes++;
-
       }
       cie.fde_size = offset;
     }
@@ -1052,16 +1182,24 @@ void BuildIdSection::copy_buf() {
   memcpy(base + 3, "GNU", 4);   // Name string
 }
 
+// The shard size is part of how a build ID is computed, so it must not
+// depend on the machine. What we adjust is the number of shards each
+// task hashes. We estimate that hashing a shard takes a millisecond.
 static void compute_sha256(u8 *buf, i64 size, u8 *digest) {
   i64 shard_size = 1024 * 1024;
   i64 num_shards = size / shard_size + 1;
   std::vector<u8> shards(num_shards * SHA256_SIZE);
 
-  tbb::parallel_for((i64)0, num_shards, [&](i64 i) {
-    u8 *begin = buf + shard_size * i;
-    i64 sz = (i < num_shards - 1) ? shard_size : (size % shard_size);
-    SHA256(begin, sz, shards.data() + i * SHA256_SIZE);
-  });
+  tbb::blocked_range<i64> range(0, num_shards,
+                                get_grain_size(num_shards, 1000000));
+
+  tbb::parallel_for(range, [&](const tbb::blocked_range<i64> &r) {
+    for (i64 i = r.begin(); i < r.end(); i++) {
+      u8 *begin = buf + shard_size * i;
+      i64 sz = (i < num_shards - 1) ? shard_size : (size % shard_size);
+      SHA256(begin, sz, shards.data() + i * SHA256_SIZE);
+    }
+  }, tbb::simple_partitioner());
 
   SHA256(shards.data(), shards.size(), digest);
 }
@@ -1081,3 +1219,162 @@ void BuildIdSection::write_buildid(i64 filesize) {
   compute_sha256(out::buf, filesize, digest);
   memcpy(out::buf + shdr.sh_offset + HEADER_SIZE, digest, get_buildid_size());
 }
+
+// .gnu_debuglink contains the filename of a separate debug info file
+// followed by its CRC-32.
+void GnuDebuglinkSection::update_shdr() {
+  std::string filename = path_filename(config.separate_debug_file);
+  shdr.sh_size = align_to(filename.size() + 1, 4) + 4;
+}
+
+void GnuDebuglinkSection::copy_buf() {
+  u8 *base = out::buf + shdr.sh_offset;
+  memset(base, 0, shdr.sh_size);
+  write_string(base, path_filename(config.separate_debug_file));
+}
+
+// We want to commit the main output file before writing the debug
+// info file, so the CRC can't be computed from the debug info file.
+// Instead, we use a fingerprint of the main file and later adjust
+// the debug info file's contents so that its CRC-32 matches it.
+void GnuDebuglinkSection::write_crc(i64 filesize) {
+  i64 shard_size = 1024 * 1024;
+  i64 num_shards = filesize / shard_size + 1;
+  std::vector<u32> shards(num_shards);
+
+  tbb::parallel_for((i64)0, num_shards, [&](i64 i) {
+    u8 *begin = out::buf + shard_size * i;
+    i64 sz = (i < num_shards - 1) ? shard_size : (filesize % shard_size);
+    shards[i] = compute_crc32(0, begin, sz);
+  });
+
+  crc = compute_crc32(0, (u8 *)shards.data(), shards.size() * 4);
+  *(u32 *)(out::buf + shdr.sh_offset + shdr.sh_size - 4) = crc;
+}
+
+// Compresses data as a raw deflate stream. All but the last shard end
+// with a full flush, which byte-aligns the output and resets the
+// dictionary, so compressed shards can simply be concatenated.
+static std::vector<u8> deflate_shard(std::string_view data, bool last) {
+  z_stream strm = {};
+  if (deflateInit2(&strm, Z_BEST_SPEED, Z_DEFLATED, -15, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    Fatal() << "deflateInit2 failed";
+
+  strm.next_in = (u8 *)data.data();
+  strm.avail_in = data.size();
+
+  std::vector<u8> vec;
+  u8 buf[65536];
+
+  do {
+    strm.next_out = buf;
+    strm.avail_out = sizeof(buf);
+    deflate(&strm, last ? Z_FINISH : Z_FULL_FLUSH);
+    vec.insert(vec.end(), buf, buf + sizeof(buf) - strm.avail_out);
+  } while (strm.avail_out == 0);
+
+  deflateEnd(&strm);
+  return vec;
+}
+
+static std::vector<u8> zstd_shard(std::string_view data) {
+  std::vector<u8> vec(ZSTD_compressBound(data.size()));
+  size_t sz = ZSTD_compress(vec.data(), vec.size(), data.data(),
+                            data.size(), 1);
+  if (ZSTD_isError(sz))
+    Fatal() << "ZSTD_compress failed";
+  vec.resize(sz);
+  return vec;
+}
+
+// Debug sections are compressed in shards of about this size.
+static constexpr i64 SHARD_SIZE = 1024 * 1024;
+
+// The constructor only splits the section into shards. Shards of all
+// debug sections are then compressed in parallel by compress_shard(),
+// and finalize() computes the section size.
+CompressedSection::CompressedSection(OutputChunk &chunk)
+  : OutputChunk(SYNTHETIC), chunk(chunk) {
+  name = chunk.name;
+  shndx = chunk.shndx;
+  shdr = chunk.shdr;
+
+  // Shards are split at piece boundaries, so that each of them can be
+  // rendered to a small buffer independently of the others.
+  shards.resize(1);
+  for (i64 i = 0; i < chunk.get_num_pieces(); i++) {
+    u64 offset = chunk.get_piece_offset(i);
+    if (offset - shards.back().begin >= SHARD_SIZE) {
+      shards.back().end = offset;
+      shards.back().piece_end = i;
+      shards.push_back({.begin = offset, .piece_begin = i});
+    }
+  }
+  shards.back().end = chunk.shdr.sh_size;
+  shards.back().piece_end = chunk.get_num_pieces();
+}
+
+// zlib output is a single zlib stream whose body consists of raw
+// deflate shards, and zstd output is a sequence of independent zstd
+// frames.
+void CompressedSection::compress_shard(i64 i) {
+  Shard &shard = shards[i];
+  std::vector<u8> buf(shard.end - shard.begin);
+
+  for (i64 j = shard.piece_begin; j < shard.piece_end; j++)
+    chunk.write_piece(j, buf.data() + chunk.get_piece_offset(j) - shard.begin);
+
+  std::string_view data((char *)buf.data(), buf.size());
+
+  if (config.compress_debug_sections == CompressKind::ZLIB) {
+    shard.data = deflate_shard(data, i == shards.size() - 1);
+    shard.adler = adler32(1, buf.data(), buf.size());
+  } else {
+    shard.data = zstd_shard(data);
+  }
+}
+
+void CompressedSection::finalize() {
+  if (config.compress_debug_sections == CompressKind::ZLIB) {
+    chdr.ch_type = ELFCOMPRESS_ZLIB;
+    header = {0x78, 0x01};
+
+    u32 checksum = shards[0].adler;
+    for (i64 i = 1; i < shards.size(); i++)
+      checksum = adler32_combine(checksum, shards[i].adler,
+                                 shards[i].end - shards[i].begin);
+    trailer = {(u8)(checksum >> 24), (u8)(checksum >> 16),
+               (u8)(checksum >> 8), (u8)checksum};
+  } else {
+    chdr.ch_type = ELFCOMPRESS_ZSTD;
+  }
+
+  chdr.ch_size = chunk.shdr.sh_size;
+  chdr.ch_addralign = chunk.shdr.sh_addralign;
+
+  shdr.sh_flags |= SHF_COMPRESSED;
+  shdr.sh_addralign = 8;
+  shdr.sh_size = sizeof(chdr) + header.size() + trailer.size();
+  for (Shard &shard : shards)
+    shdr.sh_size += shard.data.size();
+}
+
+void CompressedSection::copy_buf() {
+  u8 *base = out::buf + shdr.sh_offset;
+  memcpy(base, &chdr, sizeof(chdr));
+  base += sizeof(chdr);
+
+  memcpy(base, header.data(), header.size());
+  base += header.size();
+
+  std::vector<i64> offsets(shards.size() + 1);
+  for (i64 i = 0; i < shards.size(); i++)
+    offsets[i + 1] = offsets[i] + shards[i].data.size();
+
+  tbb::parallel_for((i64)0, (i64)shards.size(), [&](i64 i) {
+    memcpy(base + offsets[i], shards[i].data.data(), shards[i].data.size());
+  });
+
+  memcpy(base + offsets.back(), trailer.data(), trailer.size());
+}
@@ -14,24 +14,24 @@ static u32 get_umask() {
 
 class MemoryMappedOutputFile : public OutputFile {
 public:
-  MemoryMappedOutputFile(std::string path, i64 filesize)
+  MemoryMappedOutputFile(std::string path, i64 filesize, bool reuse_existing)
     : OutputFile(path, filesize) {
-    std::string dir = dirname(strdup(config.output.c_str()));
+    std::string dir = dirname(strdup(path.c_str()));
     tmpfile = strdup((dir + "/.mold-XXXXXX").c_str());
     i64 fd = mkstemp(tmpfile);
     if (fd == -1)
       Error() << "cannot open " << tmpfile <<  ": " << strerror(errno);
 
-    if (rename(config.output.c_str(), tmpfile) == 0) {
+    if (reuse_existing && rename(path.c_str(), tmpfile) == 0) {
       ::close(fd);
       fd = ::open(tmpfile, O_RDWR | O_CREAT, 0777);
       if (fd == -1) {
         if (errno != ETXTBSY)
-          Error() << "cannot open " << config.output << ": " << strerror(errno);
+          Error() << "cannot open " << path << ": " << strerror(errno);
         unlink(tmpfile);
         fd = ::open(tmpfile, O_RDWR | O_CREAT, 0777);
         if (fd == -1)
-          Error() << "cannot open " << config.output << ": " << strerror(errno);
+          Error() << "cannot open " << path << ": " << strerror(errno);
       }
     }
 
@@ -43,15 +43,25 @@ public:
 
     buf = (u8 *)mmap(nullptr, filesize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (buf == MAP_FAILED)
-      Error() << config.output << ": mmap failed: " << strerror(errno);
+      Error() << path << ": mmap failed: " << strerror(errno);
     ::close(fd);
   }
 
+  void remap(u64 new_size) override {
+    if (truncate(tmpfile, new_size))
+      Error() << "truncate failed: " << strerror(errno);
+
+    buf = (u8 *)mremap(buf, filesize, new_size, MREMAP_MAYMOVE);
+    if (buf == MAP_FAILED)
+      Error() << path << ": mremap failed: " << strerror(errno);
+    filesize = new_size;
+  }
+
   void close() override {
     Timer t("munmap");
     munmap(buf, filesize);
-    if (rename(tmpfile, config.output.c_str()) == -1)
-      Error() << config.output << ": rename filed: " << strerror(errno);
+    if (rename(tmpfile, path.c_str()) == -1)
+      Error() << path << ": rename filed: " << strerror(errno);
     tmpfile = nullptr;
   }
 };
@@ -66,11 +76,23 @@ public:
       Error() << "mmap failed: " << strerror(errno);
   }
 
+  void remap(u64 new_size) override {
+    u8 *buf2 = (u8 *)mmap(NULL, new_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (buf2 == MAP_FAILED)
+      Error() << "mmap failed: " << strerror(errno);
+
+    memcpy(buf2, buf, std::min(filesize, new_size));
+    munmap(buf, filesize);
+    buf = buf2;
+    filesize = new_size;
+  }
+
   void close() override {
     Timer t("munmap");
     i64 fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0777);
     if (fd == -1)
-      Error() << "cannot open " << config.output << ": " << strerror(errno);
+      Error() << "cannot open " << path << ": " << strerror(errno);
 
     FILE *fp = fdopen(fd, "w");
     fwrite(buf, filesize, 1, fp);
@@ -78,7 +100,13 @@ public:
   }
 };
 
-OutputFile *OutputFile::open(std::string path, u64 filesize) {
+// Creates an output file. By default, an existing file at `path` is
+// moved to a temporary name and overwritten, which is faster than
+// creating a new file. If `reuse_existing` is false, a new temporary
+// file is created instead, and an existing file is left untouched
+// until close(), so that an error until then doesn't remove it.
+OutputFile *OutputFile::open(std::string path, u64 filesize,
+                             bool reuse_existing) {
   Timer t("open_file");
 
   bool is_special = false;
@@ -90,9 +118,21 @@ OutputFile *OutputFile::open(std::string path, u64 filesize) {
   if (is_special)
     file = new MallocOutputFile(path, filesize);
   else
-    file = new MemoryMappedOutputFile(path, filesize);
+    file = new MemoryMappedOutputFile(path, filesize, reuse_existing);
 
   if (config.filler != -1)
     memset(file->buf, config.filler, filesize);
   return file;
 }
+
+// Changes the size of an output file, keeping its contents. This is
+// used by --early-copy, which creates an output file before the final
+// file size is known.
+void OutputFile::resize(u64 new_size) {
+  Timer t("resize_file");
+  u64 old_size = filesize;
+  remap(new_size);
+
+  if (config.filler != -1 && old_size < new_size)
+    memset(buf + old_size, config.filler, new_size - old_size);
+}
@@ -1,10 +1,16 @@
 #include "mold.h"
 
+#include <cmath>
+#include <fstream>
 #include <functional>
 #include <iomanip>
 #include <ios>
+#include <regex>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <tbb/parallel_for.h>
+#include <unistd.h>
 
 i64 Counter::get_value() {
   return values.combine(std::plus());
@@ -20,12 +26,122 @@ void Counter::print() {
               << "=" << c->get_value() << "\n";
 }
 
-static i64 now_nsec() {
+i64 now_nsec() {
   struct timespec t;
   clock_gettime(CLOCK_MONOTONIC, &t);
   return (i64)t.tv_sec * 1000000000 + t.tv_nsec;
 }
 
+#ifdef LOCK_STATS
+// Prints synchronization points sorted by total wait time.
+void LockStat::print() {
+  struct Entry {
+    std::string_view name;
+    Value val;
+  };
+
+  // Sites in templates are instantiated more than once.
+  // Merge instances with the same name.
+  std::map<std::string_view, Value> map;
+  for (LockStat *stat : instances) {
+    for (Value &v : stat->values) {
+      Value &sum = map[stat->name];
+      sum.acquired += v.acquired;
+      sum.contended += v.contended;
+      sum.wait += v.wait;
+      sum.retries += v.retries;
+    }
+  }
+
+  std::vector<Entry> vec;
+  for (auto &[name, val] : map)
+    vec.push_back({name, val});
+
+  sort(vec, [](const Entry &a, const Entry &b) {
+    return a.val.wait > b.val.wait;
+  });
+
+  std::cout << "   Acquired  Contended    Wait ms    Retries  Site\n";
+
+  for (i64 i = 0; i < vec.size() && i < 20; i++) {
+    Value &val = vec[i].val;
+    printf(" %10ld %10ld % 10.3f %10ld  %s\n", val.acquired, val.contended,
+           (double)val.wait / 1000000, val.retries,
+           std::string(vec[i].name).c_str());
+  }
+
+  std::cout << std::flush;
+}
+#endif
+
+i64 FileCounter::get_value(InputFile *file) {
+  i64 val = 0;
+  for (std::unordered_map<InputFile *, i64> &map : values)
+    if (auto it = map.find(file); it != map.end())
+      val += it->second;
+  return val;
+}
+
+// Prints input files that took the longest time to process
+// for --time-trace-files.
+void print_file_stats() {
+  struct Entry {
+    InputFile *file;
+    i64 parse_time;
+    i64 copy_time;
+    i64 num_syms = 0;
+    i64 num_rels = 0;
+    i64 bytes = 0;
+    i64 discarded;
+  };
+
+  std::vector<InputFile *> files;
+  append(files, out::objs);
+  append(files, out::dsos);
+
+  std::vector<Entry> vec(files.size());
+
+  tbb::parallel_for((i64)0, (i64)files.size(), [&](i64 i) {
+    InputFile *file = files[i];
+    Entry &ent = vec[i];
+    ent.file = file;
+    ent.parse_time = file_stats::parse_time.get_value(file);
+    ent.copy_time = file_stats::copy_time.get_value(file);
+    ent.discarded = file_stats::discarded_bytes.get_value(file);
+    ent.num_syms = file->symbols.size();
+
+    if (file->is_dso)
+      return;
+
+    ObjectFile *obj = (ObjectFile *)file;
+    for (InputSection *isec : obj->sections) {
+      if (isec) {
+        ent.num_rels += isec->rels.size();
+        if (isec->is_alive)
+          ent.bytes += isec->shdr.sh_size;
+      }
+    }
+  });
+
+  sort(vec, [](const Entry &a, const Entry &b) {
+    return a.parse_time + a.copy_time > b.parse_time + b.copy_time;
+  });
+
+  std::cout << " Parse ms  Copy ms  Symbols    Relocs       Bytes"
+            << "   Discarded  File\n";
+
+  for (i64 i = 0; i < vec.size() && i < 20; i++) {
+    Entry &ent = vec[i];
+    printf(" % 8.3f % 8.3f %8ld %9ld %11ld %11ld  ",
+           (double)ent.parse_time / 1000000,
+           (double)ent.copy_time / 1000000,
+           ent.num_syms, ent.num_rels, ent.bytes, ent.discarded);
+    std::cout << *ent.file << "\n";
+  }
+
+  std::cout << std::flush;
+}
+
 static i64 to_nsec(struct timeval t) {
   return (i64)t.tv_sec * 1000000000 + t.tv_usec * 1000;
 }
@@ -90,3 +206,225 @@ void Timer::print() {
 
   std::cout << std::flush;
 }
+
+// Restarts running timers. A forked child process calls this function
+// because its rusage counters start from zero.
+void Timer::restart_all() {
+  for (TimerRecord *rec : records)
+    if (!rec->stopped)
+      *rec = TimerRecord(rec->name);
+}
+
+void Timer::write_records(int fd) {
+  for (i64 i = records.size() - 1; i >= 0; i--)
+    records[i]->stop();
+
+  std::stringstream ss;
+  for (TimerRecord *rec : records)
+    ss << rec->name << "\t" << (rec->end - rec->start) << "\t"
+       << rec->user << "\t" << rec->sys << "\n";
+
+  std::string str = ss.str();
+  for (i64 i = 0; i < str.size();) {
+    i64 n = write(fd, str.data() + i, str.size() - i);
+    if (n <= 0)
+      return;
+    i += n;
+  }
+}
+
+struct PhaseStats {
+  std::string name;
+  std::vector<double> real;
+  std::vector<double> user;
+  std::vector<double> sys;
+};
+
+static double median(std::vector<double> vec) {
+  std::sort(vec.begin(), vec.end());
+  i64 n = vec.size();
+  return (n % 2) ? vec[n / 2] : (vec[n / 2 - 1] + vec[n / 2]) / 2;
+}
+
+static double variance(std::vector<double> &vec) {
+  if (vec.size() < 2)
+    return 0;
+
+  double mean = 0;
+  for (double x : vec)
+    mean += x;
+  mean /= vec.size();
+
+  double sum = 0;
+  for (double x : vec)
+    sum += (x - mean) * (x - mean);
+  return sum / (vec.size() - 1);
+}
+
+static std::string read_all(int fd) {
+  std::string str;
+  char buf[4096];
+  for (;;) {
+    i64 n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      return str;
+    str.append(buf, n);
+  }
+}
+
+// Adds one run's timer records to `phases`. A phase that is timed
+// more than once in a run is counted as the sum of its records.
+static void add_run(std::vector<PhaseStats> &phases, std::string_view data) {
+  std::map<std::string, std::array<double, 3>> run;
+  std::vector<std::string> names;
+
+  std::istringstream in{std::string(data)};
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    i64 real, user, sys;
+    if (!std::getline(fields, name, '\t') || !(fields >> real >> user >> sys))
+      Fatal() << "bench: malformed timer record: " << line;
+
+    if (!run.contains(name))
+      names.push_back(name);
+    std::array<double, 3> &val = run[name];
+    val[0] += (double)real / 1000000000;
+    val[1] += (double)user / 1000000000;
+    val[2] += (double)sys / 1000000000;
+  }
+
+  for (std::string &name : names) {
+    auto it = std::find_if(phases.begin(), phases.end(),
+                           [&](PhaseStats &p) { return p.name == name; });
+    if (it == phases.end()) {
+      phases.push_back({name});
+      it = phases.end() - 1;
+    }
+
+    it->real.push_back(run[name][0]);
+    it->user.push_back(run[name][1]);
+    it->sys.push_back(run[name][2]);
+  }
+}
+
+static void save_baseline(std::vector<PhaseStats> &phases) {
+  std::ofstream out(config.bench_save);
+  if (!out)
+    Fatal() << "cannot open " << config.bench_save << ": " << strerror(errno);
+
+  out << std::setprecision(9)
+      << "{\n  \"runs\": " << config.bench_runs << ",\n  \"phases\": [\n";
+
+  for (i64 i = 0; i < phases.size(); i++) {
+    PhaseStats &p = phases[i];
+    out << "    {\"name\": \"" << p.name << "\""
+        << ", \"median\": " << median(p.real)
+        << ", \"variance\": " << variance(p.real)
+        << ", \"user\": " << median(p.user)
+        << ", \"sys\": " << median(p.sys) << "}"
+        << (i + 1 < phases.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+// Reads a file written by --bench-save. Returns a map from phase names
+// to their median and variance.
+static std::map<std::string, std::pair<double, double>> load_baseline() {
+  std::ifstream in(config.bench_compare);
+  if (!in)
+    Fatal() << "cannot open " << config.bench_compare << ": " << strerror(errno);
+
+  static std::regex re(R"re(\{"name": "([^"]*)", "median": ([^,]+), "variance": ([^,]+),)re");
+
+  std::map<std::string, std::pair<double, double>> map;
+  std::string line;
+  while (std::getline(in, line))
+    if (std::smatch m; std::regex_search(line, m, re))
+      map[m[1]] = {std::stod(m[2]), std::stod(m[3])};
+
+  if (map.empty())
+    Fatal() << config.bench_compare << ": no benchmark results found";
+  return map;
+}
+
+// Runs the rest of the link config.bench_runs times, each in a new
+// child process, and reports per-phase medians. If a baseline is given,
+// the parent exits with 1 if any phase became slower than the baseline
+// by more than config.bench_threshold percent and by more than twice the
+// baseline's standard deviation.
+//
+// This function returns only in child processes. The returned function
+// sends the child's timer records to the parent.
+std::function<void()> run_benchmark() {
+  std::vector<PhaseStats> phases;
+
+  for (i64 i = 0; i < config.bench_runs; i++) {
+    int pipefd[2];
+    if (pipe(pipefd) == -1) {
+      perror("pipe");
+      exit(1);
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+      perror("fork");
+      exit(1);
+    }
+
+    if (pid == 0) {
+      // Child
+      close(pipefd[0]);
+      Timer::restart_all();
+      return [=]() {
+        Timer::write_records(pipefd[1]);
+        close(pipefd[1]);
+      };
+    }
+
+    // Parent
+    close(pipefd[1]);
+    std::string data = read_all(pipefd[0]);
+    close(pipefd[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      Fatal() << "bench: run " << (i + 1) << " failed";
+    add_run(phases, data);
+  }
+
+  if (!config.bench_save.empty())
+    save_baseline(phases);
+
+  std::map<std::string, std::pair<double, double>> baseline;
+  if (!config.bench_compare.empty())
+    baseline = load_baseline();
+
+  bool regressed = false;
+
+  std::cout << "   Median   Stddev  Baseline   Change  Name\n";
+
+  for (PhaseStats &p : phases) {
+    double val = median(p.real);
+    printf(" % 8.3f % 8.3f", val, sqrt(variance(p.real)));
+
+    auto it = baseline.find(p.name);
+    if (it == baseline.end()) {
+      printf("         -        -  %s\n", p.name.c_str());
+      continue;
+    }
+
+    auto [base, var] = it->second;
+    double change = (base > 0) ? (val - base) / base * 100 : 0;
+    bool slow = val > base * (1 + config.bench_threshold / 100.0) &&
+                val - base > 2 * sqrt(var);
+    printf("  % 8.3f %+7.1f%%  %s%s\n", base, change, p.name.c_str(),
+           slow ? "  REGRESSED" : "");
+    regressed |= slow;
+  }
+
+  std::cout << std::flush;
+  exit(regressed ? 1 : 0);
+}
@@ -0,0 +1,155 @@
+#include "mold.h"
+
+// This file implements a writer and a reader of the POSIX ustar file
+// format, which is used by --reproduce and --replay. A file whose name
+// does not fit in the ustar header is preceded by a PAX extended
+// header containing the full name.
+
+struct UstarHeader {
+  char name[100];
+  char mode[8];
+  char uid[8];
+  char gid[8];
+  char size[12];
+  char mtime[12];
+  char checksum[8];
+  char typeflag[1];
+  char linkname[100];
+  char magic[6];
+  char version[2];
+  char uname[32];
+  char gname[32];
+  char devmajor[8];
+  char devminor[8];
+  char prefix[155];
+  char pad[12];
+};
+
+static_assert(sizeof(UstarHeader) == TarWriter::BLOCK_SIZE);
+
+static void finalize(UstarHeader &hdr) {
+  memcpy(hdr.mode, "0000664", 8);
+  memcpy(hdr.uid, "0000000", 8);
+  memcpy(hdr.gid, "0000000", 8);
+  memcpy(hdr.mtime, "00000000000", 12);
+  memcpy(hdr.magic, "ustar", 6);
+  memcpy(hdr.version, "00", 2);
+  memset(hdr.checksum, ' ', sizeof(hdr.checksum));
+
+  u32 sum = 0;
+  for (i64 i = 0; i < sizeof(hdr); i++)
+    sum += ((u8 *)&hdr)[i];
+  snprintf(hdr.checksum, sizeof(hdr.checksum), "%06o", sum);
+}
+
+// A PAX record is "<length> <key>=<value>\n" where <length> is the
+// length of the entire record including the length field itself.
+static std::string encode_pax_record(std::string key, std::string val) {
+  i64 len = key.size() + val.size() + 3;
+  i64 total = len + std::to_string(len).size();
+  total = len + std::to_string(total).size();
+  return std::to_string(total) + " " + key + "=" + val + "\n";
+}
+
+TarWriter::TarWriter(std::string path, std::string basedir)
+  : basedir(basedir) {
+  out = fopen(path.c_str(), "w");
+  if (!out)
+    Fatal() << "cannot open " << path << ": " << strerror(errno);
+}
+
+TarWriter::~TarWriter() {
+  // A tar file ends with two zero-filled blocks.
+  char buf[BLOCK_SIZE * 2] = {};
+  fwrite(buf, sizeof(buf), 1, out);
+  fclose(out);
+}
+
+void TarWriter::append(std::string path, std::string_view data) {
+  path = basedir + "/" + path;
+
+  UstarHeader hdr = {};
+
+  if (path.size() >= sizeof(hdr.name)) {
+    std::string attr = encode_pax_record("path", path);
+    UstarHeader pax = {};
+    memcpy(pax.name, "././@PaxHeader", 14);
+    pax.typeflag[0] = 'x';
+    snprintf(pax.size, sizeof(pax.size), "%011lo", attr.size());
+    finalize(pax);
+    write_block(&pax, sizeof(pax));
+    write_block(attr.data(), attr.size());
+  }
+
+  memcpy(hdr.name, path.data(), std::min(path.size(), sizeof(hdr.name) - 1));
+  hdr.typeflag[0] = '0';
+  snprintf(hdr.size, sizeof(hdr.size), "%011lo", data.size());
+  finalize(hdr);
+  write_block(&hdr, sizeof(hdr));
+  write_block(data.data(), data.size());
+}
+
+// Writes data and pads it to the next block boundary.
+void TarWriter::write_block(const void *data, i64 size) {
+  static const char zero[BLOCK_SIZE] = {};
+  fwrite(data, size, 1, out);
+  fwrite(zero, align_to(size, BLOCK_SIZE) - size, 1, out);
+}
+
+// Returns files in a tar file as slices of a given file. Each name is
+// relative to the top-level directory of the archive.
+std::vector<std::pair<std::string, MemoryMappedFile *>>
+read_tar(MemoryMappedFile *mb) {
+  std::vector<std::pair<std::string, MemoryMappedFile *>> vec;
+  std::string long_name;
+  u8 *data = mb->data();
+  i64 pos = 0;
+
+  while (pos + TarWriter::BLOCK_SIZE <= mb->size()) {
+    UstarHeader &hdr = *(UstarHeader *)(data + pos);
+    if (hdr.name[0] == '\0')
+      break;
+
+    if (memcmp(hdr.magic, "ustar", 5))
+      Fatal() << mb->name << ": not a tar file";
+
+    i64 size = strtol(std::string(hdr.size, sizeof(hdr.size)).c_str(),
+                      nullptr, 8);
+    i64 start = pos + TarWriter::BLOCK_SIZE;
+    if (start + size > mb->size())
+      Fatal() << mb->name << ": premature end of file";
+    pos = start + align_to(size, TarWriter::BLOCK_SIZE);
+
+    if (hdr.typeflag[0] == 'x') {
+      std::string_view rec((char *)data + start, size);
+      while (!rec.empty()) {
+        i64 len = atol(std::string(rec.substr(0, rec.find(' '))).c_str());
+        if (len <= 0 || len > rec.size())
+          Fatal() << mb->name << ": corrupted PAX header";
+
+        std::string_view kv = rec.substr(0, len - 1);
+        kv = kv.substr(kv.find(' ') + 1);
+        if (kv.starts_with("path="))
+          long_name = kv.substr(5);
+        rec = rec.substr(len);
+      }
+      continue;
+    }
+
+    if (hdr.typeflag[0] != '0' && hdr.typeflag[0] != '\0') {
+      long_name = "";
+      continue;
+    }
+
+    std::string name = long_name.empty()
+      ? std::string(hdr.name, strnlen(hdr.name, sizeof(hdr.name)))
+      : long_name;
+    long_name = "";
+
+    size_t slash = name.find('/');
+    if (slash != name.npos)
+      name = name.substr(slash + 1);
+    vec.push_back({name, mb->slice(name, start, size)});
+  }
+  return vec;
+}
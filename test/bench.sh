@@ -0,0 +1,27 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+.globl _start
+_start:
+  nop
+EOF
+
+../mold -static -o $t/exe $t/a.o --bench=3 --bench-save=$t/base.json > $t/log
+grep -q '"runs": 3' $t/base.json
+grep -q '"name": "all"' $t/base.json
+grep -q ' all$' $t/log
+
+../mold -static -o $t/exe $t/a.o --bench=3 --bench-compare=$t/base.json \
+  --bench-threshold=100000 > $t/log
+! grep -q REGRESSED $t/log
+
+sed 's/"median": [^,]*, "variance": [^,]*,/"median": 0, "variance": 0,/' \
+  $t/base.json > $t/zero.json
+! ../mold -static -o $t/exe $t/a.o --bench=3 --bench-compare=$t/zero.json > $t/log
+grep -q 'all  REGRESSED' $t/log
+
+echo OK
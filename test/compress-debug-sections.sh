@@ -0,0 +1,42 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+# Debug info larger than a compression shard
+seq 1 300000 > $t/data
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl _start
+_start:
+  mov \$60, %rax
+  mov \$42, %rdi
+  syscall
+  .section .debug_info,"",@progbits
+  .incbin "$t/data"
+  .quad _start
+  .section .debug_str,"MS",@progbits,1
+  .string "foo"
+EOF
+
+../mold -static -o $t/exe1 $t/a.o
+../mold -static -o $t/exe2 $t/a.o --compress-debug-sections=zlib
+../mold -static -o $t/exe3 $t/a.o --compress-debug-sections=zstd
+
+readelf -S $t/exe2 | grep -A1 '\.debug_info' | grep -q ' C '
+readelf -S $t/exe3 | grep -A1 '\.debug_info' | grep -q ' C '
+[ $(stat -c %s $t/exe2) -lt $(stat -c %s $t/exe1) ]
+[ $(stat -c %s $t/exe3) -lt $(stat -c %s $t/exe1) ]
+
+objcopy --dump-section .debug_info=$t/debug1 $t/exe1 $t/exe1.tmp
+objcopy --decompress-debug-sections $t/exe2 $t/exe2.tmp
+objcopy --dump-section .debug_info=$t/debug2 $t/exe2.tmp $t/exe2.tmp2
+cmp $t/debug1 $t/debug2
+
+set +e
+$t/exe2
+[ $? = 42 ]
+
+echo OK
@@ -0,0 +1,54 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+seq 1 100000 > $t/data
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl _start
+_start:
+  mov \$60, %rax
+  mov \$42, %rdi
+  syscall
+  .section .debug_info,"",@progbits
+  .incbin "$t/data"
+  .quad _start
+  .section .debug_str,"MS",@progbits,1
+  .string "foo"
+  .string "bar"
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .section .debug_info,"",@progbits
+  .incbin "$t/data"
+  .section .debug_str,"MS",@progbits,1
+  .string "bar"
+  .string "baz"
+EOF
+
+../mold -static -o $t/exe1 $t/a.o $t/b.o
+
+objcopy --compress-debug-sections=zlib $t/a.o $t/a2.o
+objcopy --compress-debug-sections=zstd $t/b.o $t/b2.o
+readelf -S $t/a2.o | grep -A1 '\.debug_info' | grep -q ' C '
+readelf -S $t/b2.o | grep -A1 '\.debug_info' | grep -q ' C '
+
+../mold -static -o $t/exe2 $t/a2.o $t/b2.o
+
+! readelf -S $t/exe2 | grep -A1 '\.debug_info' | grep -q ' C ' || false
+
+objcopy --dump-section .debug_info=$t/info1 $t/exe1 $t/exe1.tmp
+objcopy --dump-section .debug_info=$t/info2 $t/exe2 $t/exe2.tmp
+cmp $t/info1 $t/info2
+
+objcopy --dump-section .debug_str=$t/str2 $t/exe2 $t/exe2.tmp
+[ "$(tr '\0' ' ' < $t/str2)" = 'foo bar baz ' ]
+
+set +e
+$t/exe2
+[ $? = 42 ]
+
+echo OK
@@ -0,0 +1,23 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .globl _start
+_start:
+  nop
+  .data
+  .quad 1
+EOF
+
+rm -f $t/exe
+../mold -static -o $t/exe $t/a.o --dry-run-layout --print-map > $t/log
+[ ! -e $t/exe ]
+grep -Eq '^ +2101264 +4112 +1 +1 \.text$' $t/log
+grep -Eq '^LOAD +2097152 +0 ' $t/log
+grep -Eq '^ +2101264 +0 +0 +_start$' $t/log
+grep -q 'File size: ' $t/log
+
+echo OK
@@ -12,6 +12,26 @@ main:
 EOF
 
 ! ../mold -o $t/exe $t/a.o $t/a.o 2> $t/log
-grep -q 'duplicate symbol: .*\.o: .*\.o: main' $t/log
+grep -q 'duplicate symbol: .*\.o: main$' $t/log
+grep -q '>>> also defined in .*\.o$' $t/log
+
+# Each symbol is reported once with a few of the files defining it.
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .text
+  .globl foo
+foo:
+  nop
+EOF
+
+! ../mold -o $t/exe $t/a.o $t/b.o $t/a.o $t/b.o $t/a.o $t/a.o $t/a.o \
+  2> $t/log
+[ "$(grep -c 'duplicate symbol' $t/log)" = 2 ]
+[ "$(grep -c '>>> also defined in .*\.o$' $t/log)" = 4 ]
+grep -q '>>> also defined in 1 more files' $t/log
+
+! ../mold -o $t/exe $t/a.o $t/b.o $t/a.o $t/b.o --error-limit=1 2> $t/log
+[ "$(grep -c 'duplicate symbol' $t/log)" = 1 ]
+grep -q 'duplicate symbol: .*\.o: foo$' $t/log
+grep -q 'too many errors emitted' $t/log
 
 echo OK
@@ -0,0 +1,78 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl main
+main:
+  lea msg(%rip), %rdi
+  xor %rax, %rax
+  call printf@PLT
+  mov ptr@GOTPCREL(%rip), %rax
+  mov (%rax), %rdi
+  xor %rax, %rax
+  call printf@PLT
+  xor %rax, %rax
+  ret
+
+  .section .rodata.str1.1,"aMS",@progbits,1
+msg:
+  .string "Hello "
+
+  .data
+ptr:
+  .quad world
+world:
+  .string "world\n"
+EOF
+
+link() {
+  ../mold "$@" /usr/lib/x86_64-linux-gnu/crt1.o \
+    /usr/lib/x86_64-linux-gnu/crti.o \
+    /usr/lib/gcc/x86_64-linux-gnu/9/crtbegin.o \
+    $t/a.o \
+    /usr/lib/gcc/x86_64-linux-gnu/9/libgcc.a \
+    /usr/lib/x86_64-linux-gnu/libgcc_s.so.1 \
+    /lib/x86_64-linux-gnu/libc.so.6 \
+    /usr/lib/x86_64-linux-gnu/libc_nonshared.a \
+    /lib/x86_64-linux-gnu/ld-linux-x86-64.so.2 \
+    /usr/lib/gcc/x86_64-linux-gnu/9/crtend.o \
+    /usr/lib/x86_64-linux-gnu/crtn.o
+}
+
+link -o $t/exe --early-copy --stats > $t/log
+$t/exe | grep -q 'Hello world'
+grep -Eq 'early_copied_chunks=[1-9]' $t/log
+! grep -Eq 'early_copy_discarded_chunks=[1-9]' $t/log || false
+
+# If the early copy is discarded, sections are copied as usual, and
+# the output must be the same.
+link -o $t/exe3 --early-copy --early-copy-discard --stats > $t/log
+grep -Eq 'early_copy_discarded_chunks=[1-9]' $t/log
+cmp $t/exe $t/exe3
+
+# A failed link must not remove an existing output file.
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .text
+  .globl foo
+foo:
+  call undef
+EOF
+
+cp $t/exe $t/exe4
+! link -o $t/exe4 --early-copy $t/b.o 2> $t/log || false
+grep -q 'undefined symbol: .*undef' $t/log
+cmp $t/exe $t/exe4
+
+# .got and .dynsym are placed after .data.
+readelf -SW $t/exe > $t/log
+grep -A100 '\.data ' $t/log | grep -q '\.got '
+grep -A100 '\.data ' $t/log | grep -q '\.dynsym '
+
+link -o $t/exe2 --early-copy --filler 0xff
+$t/exe2 | grep -q 'Hello world'
+
+echo OK
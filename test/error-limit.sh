@@ -0,0 +1,35 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl main
+main:
+  .rept 100
+  call foo
+  .endr
+  call bar1
+  call bar2
+  call bar3
+EOF
+
+! ../mold -o $t/exe $t/a.o 2> $t/log
+[ "$(grep -c 'undefined symbol: .*\.o: foo' $t/log)" = 1 ]
+[ "$(grep -c '>>> referenced by ' $t/log)" = 6 ]
+[ "$(grep '>>> referenced by ' $t/log | sort -u | wc -l)" = 6 ]
+[ "$(grep -c '>>> referenced by .*:(\.text+0x[0-9a-f]*)$' $t/log)" = 6 ]
+grep -q '>>> referenced by .*\.o:(\.text+0x1)$' $t/log
+grep -q '>>> referenced 97 more times' $t/log
+
+# Symbols are reported in the order of their names, no matter which
+# ones were found first.
+! ../mold -o $t/exe $t/a.o --error-limit=2 2> $t/log
+[ "$(grep -c 'undefined symbol' $t/log)" = 2 ]
+grep -q 'undefined symbol: .*\.o: bar1$' $t/log
+grep -q 'undefined symbol: .*\.o: bar2$' $t/log
+grep -q 'too many errors emitted' $t/log
+
+echo OK
@@ -0,0 +1,40 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -xc -g -O1 -ffunction-sections -
+int unused1(int x) { return x + 1; }
+
+void _start() {
+  asm("mov \$60, %rax; mov \$42, %rdi; syscall");
+}
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -xc -g -O1 -ffunction-sections -
+int unused2(int x) { return x * 2; }
+EOF
+
+../mold -static -o $t/exe1 $t/a.o $t/b.o --gc-sections
+../mold -static -o $t/exe2 $t/a.o $t/b.o --gc-sections --gc-debug-info
+
+# Debug info for b.o is removed because all its code is discarded.
+objcopy --dump-section .debug_info=$t/info1 $t/exe1 $t/exe1.tmp
+objcopy --dump-section .debug_info=$t/info2 $t/exe2 $t/exe2.tmp
+[ $(stat -c%s $t/info2) -lt $(stat -c%s $t/info1) ]
+readelf --debug-dump=info $t/exe2 > $t/log
+grep -q _start $t/log
+! grep -q unused2 $t/log || false
+
+# The line number sequence for unused1 is removed.
+objcopy --dump-section .debug_line=$t/line1 $t/exe1 $t/exe1.tmp
+objcopy --dump-section .debug_line=$t/line2 $t/exe2 $t/exe2.tmp
+[ $(stat -c%s $t/line2) -lt $(stat -c%s $t/line1) ]
+readelf --debug-dump=decodedline $t/exe2 | grep -q 'Stmt'
+
+set +e
+$t/exe2
+[ $? = 42 ]
+
+echo OK
@@ -0,0 +1,33 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -xc -g -gdwarf-4 -ggnu-pubnames -O1 -
+int foo(int x) { return x + 1; }
+
+void _start() {
+  asm("mov \$60, %rax; mov \$42, %rdi; syscall");
+}
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -xc -g -gdwarf-4 -ggnu-pubnames -O1 -
+int bar(int x) { return x * 2; }
+EOF
+
+../mold -static -o $t/exe $t/a.o $t/b.o --gdb-index
+
+readelf --debug-dump=gdb_index $t/exe > $t/log
+grep -q 'Version 7' $t/log
+grep -Eq '\] foo:' $t/log
+grep -Eq '\] bar:' $t/log
+
+../mold -static -o $t/exe2 $t/a.o $t/b.o
+! readelf -S $t/exe2 | grep -q '\.gdb_index' || false
+
+set +e
+$t/exe
+[ $? = 42 ]
+
+echo OK
@@ -0,0 +1,128 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+# Create a .bss larger than 4 GiB. NOBITS sections don't occupy space
+# in files, so the output stays small.
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl _start
+_start:
+  nop
+
+  .section .bss.foo,"aw",@nobits
+  .globl foo
+foo:
+  .zero 0xc0000000
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .section .bss.bar,"aw",@nobits
+  .globl bar
+bar:
+  .zero 0xc0000000
+EOF
+
+cat <<EOF | cc -o $t/c.o -c -x assembler -
+  .section .bss.baz,"aw",@nobits
+  .globl baz
+baz:
+  .zero 16
+EOF
+
+../mold -static -o $t/exe $t/a.o $t/b.o $t/c.o
+
+foo=$(nm $t/exe | awk '/ foo$/ { print $1 }')
+baz=$(nm $t/exe | awk '/ baz$/ { print $1 }')
+[ $(( 0x$baz - 0x$foo )) = $(( 0x180000000 )) ]
+
+# Do the same for PROGBITS sections. Assembling them would write out
+# gigabytes of zeros, so we create sparse object files instead and
+# only compute the layout.
+cat <<'EOF' | cc -o $t/gen -x c -
+#include <elf.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIZE 0xc0000000
+
+int main(int argc, char **argv) {
+  static const char shstrtab[] = "\0.data.big\0.shstrtab\0.symtab\0.strtab";
+
+  struct {
+    Elf64_Ehdr ehdr;
+    Elf64_Shdr shdr[5];
+    Elf64_Sym sym[2];
+    char shstrtab[sizeof(shstrtab)];
+    char strtab[16];
+  } obj = {0};
+
+  memcpy(obj.shstrtab, shstrtab, sizeof(shstrtab));
+  strcpy(obj.strtab + 1, argv[2]);
+
+  memcpy(obj.ehdr.e_ident, ELFMAG, SELFMAG);
+  obj.ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  obj.ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  obj.ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  obj.ehdr.e_type = ET_REL;
+  obj.ehdr.e_machine = EM_X86_64;
+  obj.ehdr.e_version = EV_CURRENT;
+  obj.ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+  obj.ehdr.e_shoff = offsetof(typeof(obj), shdr);
+  obj.ehdr.e_shentsize = sizeof(Elf64_Shdr);
+  obj.ehdr.e_shnum = 5;
+  obj.ehdr.e_shstrndx = 2;
+
+  // Section contents are a hole at the end of the file.
+  obj.shdr[1] = (Elf64_Shdr){1, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,
+                             0, 4096, SIZE, 0, 0, 4096, 0};
+  obj.shdr[2] = (Elf64_Shdr){11, SHT_STRTAB, 0, 0,
+                             offsetof(typeof(obj), shstrtab),
+                             sizeof(shstrtab), 0, 0, 1, 0};
+  obj.shdr[3] = (Elf64_Shdr){21, SHT_SYMTAB, 0, 0,
+                             offsetof(typeof(obj), sym), sizeof(obj.sym),
+                             4, 1, 8, sizeof(Elf64_Sym)};
+  obj.shdr[4] = (Elf64_Shdr){29, SHT_STRTAB, 0, 0,
+                             offsetof(typeof(obj), strtab),
+                             sizeof(obj.strtab), 0, 0, 1, 0};
+
+  obj.sym[1].st_name = 1;
+  obj.sym[1].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT);
+  obj.sym[1].st_shndx = 1;
+  obj.sym[1].st_size = SIZE;
+
+  int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd == -1 || write(fd, &obj, sizeof(obj)) != sizeof(obj) ||
+      ftruncate(fd, 4096 + SIZE))
+    return 1;
+  return 0;
+}
+EOF
+
+$t/gen $t/d.o foo2
+$t/gen $t/e.o bar2
+
+cat <<EOF | cc -o $t/f.o -c -x assembler -
+  .globl _start
+_start:
+  nop
+
+  .section .data.baz,"aw",@progbits
+  .globl baz2
+baz2:
+  .quad 42
+EOF
+
+../mold -static -o $t/exe2 $t/d.o $t/e.o $t/f.o --dry-run-layout \
+  --print-map > $t/log
+
+foo=$(awk '/ foo2$/ { print $1 }' $t/log)
+baz=$(awk '/ baz2$/ { print $1 }' $t/log)
+[ $(( baz - foo )) = $(( 0x180000000 )) ]
+
+echo OK
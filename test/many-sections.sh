@@ -0,0 +1,32 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+# Create an object file with more than 65535 sections, each of which
+# becomes a separate output section.
+(
+  echo '.globl _start'
+  echo '_start:'
+  echo '  movzbl foo70000(%rip), %edi'
+  echo '  mov $60, %eax'
+  echo '  syscall'
+  seq 1 70000 | sed 's/.*/.section .foo.&,"a",@progbits\nfoo&:\n.byte 42/'
+) | cc -o $t/a.o -c -x assembler -
+
+readelf -S $t/a.o | grep -q "\.symtab_shndx"
+
+../mold -static -o $t/exe $t/a.o
+readelf -h $t/exe > $t/log
+grep -Eq 'Number of section headers: +0 \(700[0-9][0-9]\)' $t/log
+grep -Eq 'Section header string table index: +65535 \(700[0-9][0-9]\)' $t/log
+
+readelf -S $t/exe | grep -q '\.symtab_shndx'
+readelf -s $t/exe | grep ' foo70000$' | awk '{ exit !($7 >= 65280) }'
+
+set +e
+$t/exe
+[ $? = 42 ]
+
+echo OK
@@ -0,0 +1,32 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl _start
+_start:
+  mov \$60, %rax
+  mov \$42, %rdi
+  syscall
+  .globl foo
+foo:
+  ret
+EOF
+
+rm -f $t/map
+../mold -static -o $t/exe $t/a.o -Map=$t/map
+grep -q '\.text' $t/map
+grep -q ' _start$' $t/map
+grep -q ' foo$' $t/map
+
+../mold -static -o $t/exe $t/a.o --print-map > $t/map2
+cmp $t/map $t/map2
+
+set +e
+$t/exe
+[ $? = 42 ]
+
+echo OK
@@ -0,0 +1,38 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl _start
+_start:
+  mov \$60, %rax
+  mov \$42, %rdi
+  syscall
+  .section .debug_info,"",@progbits
+  .zero 10000, 0x11
+  .section .debug_str,"MS",@progbits,1
+  .string "foo"
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .data
+  .quad 5
+  .section .debug_info,"",@progbits
+  .zero 10000, 0x22
+  .quad _start
+  .section .debug_str,"MS",@progbits,1
+  .string "bar"
+EOF
+
+../mold -static -o $t/exe1 $t/a.o $t/b.o
+../mold -static -o $t/exe2 $t/a.o $t/b.o --memory-budget=4K
+cmp $t/exe1 $t/exe2
+
+set +e
+$t/exe2
+[ $? = 42 ]
+
+echo OK
@@ -0,0 +1,33 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl _start
+_start:
+  mov \$60, %rax
+  mov \$42, %rdi
+  syscall
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .text
+  .globl foo
+foo:
+  ret
+  .data
+  .quad foo
+EOF
+
+../mold -static -o $t/exe1 $t/a.o $t/b.o
+../mold -static -o $t/exe2 $t/a.o $t/b.o --numa
+cmp $t/exe1 $t/exe2
+
+set +e
+$t/exe2
+[ $? = 42 ]
+
+echo OK
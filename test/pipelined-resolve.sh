@@ -0,0 +1,49 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -xc -
+int three();
+int five();
+__attribute__((weak)) int seven() { return 0; }
+
+void _start() {
+  int x = three() + five() + seven();
+  asm("mov \$60, %%rax; mov %0, %%edi; syscall" :: "r"(x));
+}
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -xc -
+int seven() { return 7; }
+EOF
+
+cat <<EOF | cc -o $t/c.o -c -xc -
+int three() { return 3; }
+EOF
+
+cat <<EOF | cc -o $t/d.o -c -xc -
+__attribute__((weak)) int three() { return 100; }
+int five() { return 5; }
+EOF
+
+rm -f $t/e.a $t/f.a
+(cd $t; ar rcs e.a c.o)
+(cd $t; ar rcs f.a d.o)
+
+# three() comes from the first archive that defines it, and the strong
+# seven() in b.o overrides the weak one in a.o.
+../mold -static -o $t/exe1 $t/a.o $t/e.a $t/f.a $t/b.o
+../mold -static -o $t/exe2 $t/a.o $t/e.a $t/f.a $t/b.o --pipelined-resolve
+cmp $t/exe1 $t/exe2
+
+../mold -static -o $t/exe3 $t/a.o $t/e.a $t/f.a $t/b.o \
+  --pipelined-resolve --thread-count=1
+cmp $t/exe1 $t/exe3
+
+set +e
+$t/exe2
+[ $? = 15 ]
+
+echo OK
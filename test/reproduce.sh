@@ -0,0 +1,36 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .globl _start
+_start:
+  call foo
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .globl foo
+foo:
+  ret
+EOF
+
+rm -f $t/b.a
+ar crs $t/b.a $t/b.o
+
+(cd $t; ../../../mold -static -o exe a.o b.a --reproduce=$t/repro.tar)
+
+tar tf $t/repro.tar > $t/log
+grep -q '^repro/response.txt$' $t/log
+grep -q '^repro/cwd.txt$' $t/log
+grep -q "^repro$t/a.o$" $t/log
+grep -q "^repro$t/b.a$" $t/log
+
+rm -f $t/a.o $t/b.a
+mkdir -p $t/replay
+(cd $t/replay; ../../../../mold --replay=$t/repro.tar --stats > log)
+cmp $t/exe $t/replay/exe
+grep -q num_objs $t/replay/log
+
+echo OK
@@ -0,0 +1,56 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl _start
+_start:
+  mov \$60, %rax
+  mov \$42, %rdi
+  syscall
+  .section .debug_info,"",@progbits
+  .zero 1000, 0x11
+  .quad _start
+  .section .debug_str,"MS",@progbits,1
+  .string "foo"
+EOF
+
+rm -f $t/exe.debug
+# The debug file is written after the main process exits unless
+# --no-fork is given.
+../mold -static -o $t/exe $t/a.o --separate-debug-file=$t/exe.debug --no-fork
+
+readelf -S $t/exe > $t/log
+grep -q '\.gnu_debuglink' $t/log
+! grep -q '\.debug_info' $t/log || false
+
+readelf -S $t/exe.debug > $t/log
+grep -q '\.debug_info' $t/log
+grep -q '\.debug_str' $t/log
+
+# The CRC-32 in .gnu_debuglink must match the debug file. A gzip
+# trailer contains the CRC-32 of its input.
+objcopy --dump-section .gnu_debuglink=$t/debuglink $t/exe $t/exe.tmp
+grep -q 'exe.debug' $t/debuglink
+[ "$(tail -c4 $t/debuglink | od -An -tx4)" = \
+  "$(gzip -c $t/exe.debug | tail -c8 | head -c4 | od -An -tx4)" ]
+
+# An undefined symbol referred to only by debug info must fail the
+# link, although the debug file is written after the link completes.
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .section .debug_info,"",@progbits
+  .quad undef
+EOF
+
+! ../mold -static -o $t/exe2 $t/a.o $t/b.o \
+  --separate-debug-file=$t/exe2.debug 2> $t/log || false
+grep -q 'undefined symbol: .*undef' $t/log
+
+set +e
+$t/exe
+[ $? = 42 ]
+
+echo OK
@@ -0,0 +1,34 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .text
+  .globl _start
+_start:
+  mov \$60, %rax
+  mov \$42, %rdi
+  syscall
+  .section .debug_info,"",@progbits
+  .zero 1000, 0x11
+  .quad _start
+  .section .debug_str,"MS",@progbits,1
+  .string "foo"
+EOF
+
+../mold -static -o $t/exe $t/a.o --strip-debug
+
+readelf -S $t/exe > $t/log
+! grep -q '\.debug' $t/log || false
+grep -q '\.symtab' $t/log
+
+../mold -static -o $t/exe $t/a.o -S
+! readelf -S $t/exe | grep -q '\.debug' || false
+
+set +e
+$t/exe
+[ $? = 42 ]
+
+echo OK
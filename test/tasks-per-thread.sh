@@ -0,0 +1,45 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+# Create an input with many sections so that they are split into
+# multiple tasks. With 16 threads, 60000 sections are split into 16
+# tasks with --tasks-per-thread=1. With --tasks-per-thread=32, tasks
+# would be smaller than the minimum grain size of 2000 sections, so
+# they are split into 31 tasks.
+{
+  echo '.globl _start'
+  echo '_start:'
+  echo '  mov $60, %rax'
+  echo '  mov $42, %rdi'
+  echo '  syscall'
+  for i in $(seq 1 60000); do
+    echo ".section .text.f$i,\"ax\",@progbits"
+    echo "f$i: ret"
+  done
+} | cc -o $t/a.o -c -x assembler -
+
+tasks() {
+  ../mold -static -o $t/exe $t/a.o --build-id --thread-count=16 \
+    --tasks-per-thread=$1 --stats | sed -n 's/^ *isec_offset_tasks=//p'
+}
+
+# Partitioning must not change the output.
+../mold -static -o $t/exe0 $t/a.o --build-id --thread-count=1
+
+n1=$(tasks 1)
+cmp $t/exe0 $t/exe
+n32=$(tasks 32)
+cmp $t/exe0 $t/exe
+[ $(( n32 - n1 )) = 15 ]
+
+! ../mold -static -o $t/exe $t/a.o --tasks-per-thread=0 2> $t/log || false
+grep -q 'invalid --tasks-per-thread argument: 0' $t/log
+
+set +e
+$t/exe0
+[ $? = 42 ]
+
+echo OK
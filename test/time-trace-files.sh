@@ -0,0 +1,29 @@
+#!/bin/bash
+set -e
+echo -n "Testing $(basename -s .sh $0) ... "
+t=$(pwd)/tmp/$(basename -s .sh $0)
+mkdir -p $t
+
+cat <<EOF | cc -o $t/a.o -c -x assembler -
+  .globl _start
+_start:
+  nop
+  .section .text.foo,"axG",@progbits,foo,comdat
+  .globl foo
+foo:
+  .zero 64
+EOF
+
+cat <<EOF | cc -o $t/b.o -c -x assembler -
+  .section .text.foo,"axG",@progbits,foo,comdat
+  .globl foo
+foo:
+  .zero 64
+EOF
+
+../mold -static -o $t/exe $t/a.o $t/b.o --time-trace-files > $t/log
+grep -q 'Parse ms  Copy ms  Symbols' $t/log
+grep -Eq ' 64  .*b\.o$' $t/log
+grep -q 'a\.o$' $t/log
+
+echo OK